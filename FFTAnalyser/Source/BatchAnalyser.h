@@ -0,0 +1,374 @@
+/*
+  ==============================================================================
+
+    BatchAnalyser.h
+    Created: 16 Oct 2026 4:22:31pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "OfflineAnalyser.h"
+#include <deque>
+
+/** Analyses many files at once on a pool of worker threads, and splits long files
+    into segments so that one big file can use every core too.
+
+    Each worker owns its own SpectrumAnalyser, and with it its own fft plans and window
+    tables. The fft frames of a segment don't depend on anything outside it, so a segment
+    is given the samples it needs, including the overlap with its neighbours, and its raw
+    magnitudes are worked out independently. The ballistics do carry state from frame to
+    frame, so they're applied afterwards, in order, by whichever worker finishes the
+    segment that the file is waiting on. That's cheap next to the ffts, and it makes the
+    output identical to an OfflineAnalyser run, frame for frame.
+
+    Segments are dealt out round robin. A worker takes its own segments from the front of
+    its queue, oldest first, and when it runs out it steals from the back of another's.
+*/
+class BatchAnalyser
+{
+public:
+    using Options = OfflineAnalyser::Options;
+    using Result = OfflineAnalyser::Result;
+    using OutputFactory = OfflineAnalyser::OutputFactory;
+
+    BatchAnalyser (const Options& optionsToUse, int numThreads, double segmentSecondsToUse = 10.) :
+        options (optionsToUse),
+        segmentSeconds (segmentSecondsToUse)
+    {
+        for (auto i = 0; i < jmax (1, numThreads); ++i)
+            workers.add (new Worker (*this, i));
+
+        // Every worker is set up the same way, so any of them can tell us the frame layout
+        const auto& analyser = workers.getUnchecked (0)->analyser;
+
+        hopSize = analyser.getHopSize ();
+        fftSize = analyser.getFftSize ();
+        numBins = analyser.getNumBins ();
+        enabledSources = OfflineAnalyser::getLayout (analyser, 0.).sources;
+    }
+
+    /** Analyses all the files, streaming each one's frames into the writer that createOutput
+        returns for it, just as OfflineAnalyser::analyse () would. createOutput is called on
+        this thread and may return nullptr. Returns a Result for each file.
+    */
+    Array<Result> analyse (const Array<File>& files, const OutputFactory& createOutput)
+    {
+        jobs.clear ();
+        startTime = Time::getMillisecondCounterHiRes ();
+
+        AudioFormatManager formatManager;
+        formatManager.registerBasicFormats ();
+
+        auto workerIndex = 0;
+
+        for (auto& file : files)
+        {
+            auto* job = jobs.add (new FileJob ());
+            job->file = file;
+
+            std::unique_ptr<AudioFormatReader> reader (formatManager.createReaderFor (file));
+
+            if (reader == nullptr)
+            {
+                job->result.error = "Couldn't open " + file.getFullPathName ();
+                continue;
+            }
+
+            job->sampleRate = reader->sampleRate;
+            job->numChannels = jmin (static_cast<int> (reader->numChannels), options.maxNumChannels);
+            job->numSamples = reader->lengthInSamples;
+            job->frameMagnitudes.resize (static_cast<size_t> (enabledSources.size () * numBins));
+
+            if (createOutput != nullptr)
+            {
+                auto layout = OfflineAnalyser::getLayout (workers.getUnchecked (0)->analyser, job->sampleRate);
+                job->output = createOutput (file, layout);
+            }
+
+            for (auto i = 0; i < enabledSources.size (); ++i)
+            {
+                auto* b = job->ballistics.add (new Ballistics ());
+                b->prepare (numBins);
+                b->setTiming ({}, static_cast<double> (hopSize) / job->sampleRate);
+            }
+
+            const auto numFrames = job->numSamples >= fftSize ? static_cast<int> ((job->numSamples - fftSize) / hopSize) + 1 : 0;
+            const auto framesPerSegment = jmax (1, roundToInt (segmentSeconds * job->sampleRate / hopSize));
+
+            for (auto firstFrame = 0; firstFrame < numFrames; firstFrame += framesPerSegment)
+            {
+                auto* segment = job->segments.add (new Segment ());
+                segment->job = job;
+                segment->firstFrame = firstFrame;
+                segment->numFrames = jmin (framesPerSegment, numFrames - firstFrame);
+
+                workers.getUnchecked (workerIndex)->queue.push_back (segment);
+                workerIndex = (workerIndex + 1) % workers.size ();
+            }
+
+            job->result.succeeded = true;
+            job->result.numSamples = job->numSamples;
+            job->result.audioSeconds = static_cast<double> (job->numSamples) / job->sampleRate;
+        }
+
+        for (auto* worker : workers)
+            worker->startThread ();
+
+        for (auto* worker : workers)
+            worker->waitForThreadToExit (-1);
+
+        Array<Result> results;
+
+        for (auto* job : jobs)
+        {
+            job->output.reset ();
+            results.add (job->result);
+        }
+
+        return results;
+    }
+
+private:
+    struct FileJob;
+
+    /** A run of consecutive frames of one file, and somewhere to keep their raw magnitudes
+        until the file is ready for them.
+    */
+    struct Segment
+    {
+        FileJob* job {nullptr};
+        int firstFrame {0};
+        int numFrames {0};
+
+        std::vector<float> storage;
+        float* magnitudes {nullptr};        // numFrames x enabled sources x numBins
+        uint32 sourcesPresent {0};          // bit n is set if enabled source n could be made
+        bool failed {false};
+        std::atomic<bool> finished {false};
+    };
+
+    struct FileJob
+    {
+        File file;
+        double sampleRate {0.};
+        int numChannels {0};
+        int64 numSamples {0};
+
+        OwnedArray<Segment> segments;
+        std::atomic<int> nextSegmentToWrite {0};
+        SpinLock writeLock;
+
+        std::unique_ptr<SpectrogramWriter> output;
+        std::vector<float> frameMagnitudes;     // a smoothed frame on its way to the output
+        OwnedArray<Ballistics> ballistics;      // one per enabled source, carried across segments
+        Result result;
+    };
+
+    class Worker : public Thread
+    {
+    public:
+        Worker (BatchAnalyser& ownerToUse, int indexToUse) :
+            Thread ("batch " + String (indexToUse)),
+            owner (ownerToUse),
+            index (indexToUse),
+            analyser (ownerToUse.options.fftOrder, ownerToUse.options.maxNumChannels)
+        {
+            formatManager.registerBasicFormats ();
+            OfflineAnalyser::configure (analyser, owner.options);
+            buffer.setSize (owner.options.maxNumChannels, owner.options.blockSize, false, false, true);
+        }
+
+        void run () override
+        {
+            while (auto* segment = owner.takeSegment (index))
+            {
+                analyseSegment (*segment);
+                segment->finished = true;
+                owner.writeFinishedSegments (*segment->job);
+            }
+        }
+
+        BatchAnalyser& owner;
+        const int index;
+
+        SpectrumAnalyser analyser;
+        AudioFormatManager formatManager;
+        AudioBuffer<float> buffer;
+
+        std::deque<Segment*> queue;
+        SpinLock queueLock;
+
+    private:
+        void analyseSegment (Segment& segment)
+        {
+            auto& job = *segment.job;
+            std::unique_ptr<AudioFormatReader> reader (formatManager.createReaderFor (job.file));
+
+            if (reader == nullptr)
+            {
+                segment.failed = true;
+                return;
+            }
+
+            const auto numSources = owner.enabledSources.size ();
+            const auto frameStride = numSources * owner.numBins;
+
+            // Keep every frame SIMD aligned, so the ballistics take the same path as they do in perform ()
+            using Vec = dsp::SIMDRegister<float>;
+            segment.storage.resize (static_cast<size_t> (segment.numFrames * frameStride) + Vec::SIMDNumElements);
+            segment.magnitudes = Vec::getNextSIMDAlignedPtr (segment.storage.data ());
+
+            const auto hop = static_cast<int64> (owner.hopSize);
+            const auto start = segment.firstFrame * hop;
+            const auto end = (segment.firstFrame + segment.numFrames - 1) * hop + owner.fftSize;
+
+            analyser.prepare (job.sampleRate, owner.options.blockSize);
+
+            const auto storeFrame = [&segment, frameStride, this] (const SpectrumAnalyser::Frame& frame)
+            {
+                const auto frameIndex = static_cast<int> (frame.samplePosition / owner.hopSize);
+                const auto slot = owner.enabledSources.indexOf (frame.source);
+
+                if (frameIndex < segment.numFrames && slot >= 0)
+                {
+                    FloatVectorOperations::copy (segment.magnitudes + frameIndex * frameStride + slot * owner.numBins,
+                                                 frame.rawMagnitudes, owner.numBins);
+                    segment.sourcesPresent |= 1u << static_cast<uint32> (slot);
+                }
+            };
+
+            for (auto position = start; position < end;)
+            {
+                const auto numToRead = static_cast<int> (jmin (int64 (owner.options.blockSize), end - position));
+                reader->read (&buffer, 0, numToRead, position, true, job.numChannels > 1);
+
+                analyser.addSamples (buffer.getArrayOfReadPointers (), job.numChannels, numToRead);
+                analyser.perform (storeFrame);
+
+                position += numToRead;
+            }
+        }
+
+    };
+
+    Segment* takeSegment (int workerIndex)
+    {
+        auto& own = *workers.getUnchecked (workerIndex);
+
+        {
+            const SpinLock::ScopedLockType sl (own.queueLock);
+
+            if (! own.queue.empty ())
+            {
+                auto* segment = own.queue.front ();
+                own.queue.pop_front ();
+                return segment;
+            }
+        }
+
+        for (auto i = 1; i < workers.size (); ++i)
+        {
+            auto& victim = *workers.getUnchecked ((workerIndex + i) % workers.size ());
+            const SpinLock::ScopedLockType sl (victim.queueLock);
+
+            if (! victim.queue.empty ())
+            {
+                auto* segment = victim.queue.back ();
+                victim.queue.pop_back ();
+                return segment;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /** Applies the ballistics to, and writes out, every finished segment the file is ready
+        for. Only one worker at a time does this for a file, and since a worker always checks
+        again after letting go, a segment that finishes in the meantime can't be missed.
+    */
+    void writeFinishedSegments (FileJob& job)
+    {
+        while (job.writeLock.tryEnter ())
+        {
+            auto numWritten = 0;
+
+            while (job.nextSegmentToWrite < job.segments.size ()
+                    && job.segments.getUnchecked (job.nextSegmentToWrite)->finished)
+            {
+                writeSegment (job, *job.segments.getUnchecked (job.nextSegmentToWrite++));
+                ++numWritten;
+            }
+
+            if (job.nextSegmentToWrite == job.segments.size () && numWritten > 0)
+                job.result.elapsedSeconds = (Time::getMillisecondCounterHiRes () - startTime) / 1000.;
+
+            job.writeLock.exit ();
+
+            const auto next = job.nextSegmentToWrite.load ();
+            if (next == job.segments.size () || ! job.segments.getUnchecked (next)->finished)
+                break;
+        }
+    }
+
+    void writeSegment (FileJob& job, Segment& segment)
+    {
+        if (segment.failed)
+        {
+            job.result.succeeded = false;
+            job.result.error = "Couldn't read " + job.file.getFullPathName ();
+            return;
+        }
+
+        const auto numSources = enabledSources.size ();
+
+        for (auto frame = 0; frame < segment.numFrames; ++frame)
+        {
+            // The storage starts out zeroed, so a slot that couldn't be made is already all zeros
+            const auto* raw = segment.magnitudes + frame * numSources * numBins;
+
+            for (auto slot = 0; slot < numSources; ++slot)
+            {
+                // Zeros, as OfflineAnalyser writes, not whatever the last frame left in the slot
+                if ((segment.sourcesPresent & (1u << static_cast<uint32> (slot))) == 0)
+                {
+                    if (options.smoothed)
+                        FloatVectorOperations::clear (job.frameMagnitudes.data () + slot * numBins, numBins);
+
+                    continue;
+                }
+
+                auto& ballistics = *job.ballistics.getUnchecked (slot);
+                ballistics.process (raw + slot * numBins);
+
+                if (options.smoothed)
+                    FloatVectorOperations::copy (job.frameMagnitudes.data () + slot * numBins, ballistics.getOutput (), numBins);
+            }
+
+            if (job.output != nullptr)
+                job.output->writeFrame ((segment.firstFrame + frame) * static_cast<int64> (hopSize),
+                                        options.smoothed ? job.frameMagnitudes.data () : raw);
+
+            ++job.result.numFrames;
+        }
+
+        segment.storage = {};
+    }
+
+    const Options options;
+    const double segmentSeconds;
+
+    int hopSize {0};
+    int fftSize {0};
+    int numBins {0};
+    Array<int> enabledSources;
+
+    OwnedArray<Worker> workers;
+    OwnedArray<FileJob> jobs;
+    double startTime {0.};
+
+    JUCE_DECLARE_NON_COPYABLE (BatchAnalyser)
+};
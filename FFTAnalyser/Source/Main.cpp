@@ -0,0 +1,207 @@
+/*
+  ==============================================================================
+
+    This file was auto-generated!
+
+    It contains the basic startup code for a JUCE application.
+
+  ==============================================================================
+*/
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "OfflineAnalyser.h"
+#include "BatchAnalyser.h"
+
+//==============================================================================
+/** The name --source takes for each SpectrumAnalyser::Source. */
+static String getSourceArgument (int source)
+{
+    switch (source)
+    {
+        case SpectrumAnalyser::sumSource:   return "sum";
+        case SpectrumAnalyser::midSource:   return "mid";
+        case SpectrumAnalyser::sideSource:  return "side";
+        default:                            return "ch" + String (source - SpectrumAnalyser::firstChannelSource + 1);
+    }
+}
+
+/** Returns the source with exactly this name, or -1 if it isn't one the analyser has. */
+static int parseSource (const String& name, int maxNumChannels)
+{
+    for (auto source = 0; source < SpectrumAnalyser::firstChannelSource + maxNumChannels; ++source)
+        if (name == getSourceArgument (source))
+            return source;
+
+    return -1;
+}
+
+static String getSourceArguments (int maxNumChannels)
+{
+    StringArray names;
+
+    for (auto source = 0; source < SpectrumAnalyser::firstChannelSource + maxNumChannels; ++source)
+        names.add (getSourceArgument (source));
+
+    return names.joinIntoString (", ");
+}
+
+static void printUsage ()
+{
+    std::cout << "Usage: FFTAnalyser [options] file..." << std::endl
+              << std::endl
+              << "  --order n         fft order, " << SpectrumAnalyser::minFftOrder << " to " << SpectrumAnalyser::maxFftOrder << " (default 12)" << std::endl
+              << "  --overlap x       fraction of each window shared with the next (default 0.75)" << std::endl
+              << "  --engine name     juce or real (default real)" << std::endl
+              << "  --window name     rectangular, triangular, hann, hamming, blackman, blackman-harris, flat-top or kaiser (default hamming)" << std::endl
+              << "  --kaiser-beta b   the kaiser window's beta (default 6)" << std::endl
+              << "  --calibration c   tone reads a sine's amplitude, noise reads broadband level per bin (default tone)" << std::endl
+              << "  --source name     " << getSourceArguments (OfflineAnalyser::Options ().maxNumChannels) << ", may be repeated (default sum)" << std::endl
+              << "  --smoothed        write the ballistics output rather than the raw magnitudes" << std::endl
+              << "  --output dir      write each file's spectrogram to dir/<name>.spectrogram" << std::endl
+              << "  --encoding name   float32, float16 or db8 (default float16)" << std::endl
+              << "  --threads n       number of worker threads, 1 analyses one file at a time on this thread (default one per core)" << std::endl
+              << "  --segment s       length in seconds of the pieces long files are split into (default 10)" << std::endl;
+}
+
+int main (int argc, char* argv[])
+{
+    OfflineAnalyser::Options options;
+    File outputDirectory;
+    auto encoding = SpectrogramFile::Encoding::float16;
+    Array<File> inputFiles;
+    auto numThreads = SystemStats::getNumCpus ();
+    auto segmentSeconds = 10.;
+    auto badArgument = false;
+
+    for (auto i = 1; i < argc; ++i)
+    {
+        const String arg (argv[i]);
+        const auto hasValue = i + 1 < argc;
+
+        if (arg == "--order" && hasValue)
+            options.fftOrder = jlimit (SpectrumAnalyser::minFftOrder, SpectrumAnalyser::maxFftOrder, String (argv[++i]).getIntValue ());
+        else if (arg == "--overlap" && hasValue)
+            options.overlap = jlimit (0.f, 0.99f, String (argv[++i]).getFloatValue ());
+        else if (arg == "--engine" && hasValue)
+            options.engine = String (argv[++i]) == "juce" ? FftEngine::Type::juce : FftEngine::Type::realFft;
+        else if (arg == "--window" && hasValue)
+            badArgument |= ! WindowFunction::getMethodFromName (argv[++i], options.window.method);
+        else if (arg == "--kaiser-beta" && hasValue)
+            options.window.kaiserBeta = jmax (0.f, String (argv[++i]).getFloatValue ());
+        else if (arg == "--calibration" && hasValue)
+        {
+            const String name (argv[++i]);
+
+            if (name == "tone")         options.window.calibration = WindowFunction::Calibration::tone;
+            else if (name == "noise")   options.window.calibration = WindowFunction::Calibration::noise;
+            else                        badArgument = true;
+        }
+        else if (arg == "--source" && hasValue)
+        {
+            const auto source = parseSource (argv[++i], options.maxNumChannels);
+
+            if (source >= 0)    options.sources.add (source);
+            else                badArgument = true;
+        }
+        else if (arg == "--smoothed")
+            options.smoothed = true;
+        else if (arg == "--threads" && hasValue)
+            numThreads = jmax (1, String (argv[++i]).getIntValue ());
+        else if (arg == "--segment" && hasValue)
+            segmentSeconds = jmax (0.1, String (argv[++i]).getDoubleValue ());
+        else if (arg == "--encoding" && hasValue)
+        {
+            const String name (argv[++i]);
+
+            if (name == "float32")      encoding = SpectrogramFile::Encoding::float32;
+            else if (name == "float16") encoding = SpectrogramFile::Encoding::float16;
+            else if (name == "db8")     encoding = SpectrogramFile::Encoding::decibels8;
+            else                        badArgument = true;
+        }
+        else if (arg == "--output" && hasValue)
+            outputDirectory = File::getCurrentWorkingDirectory ().getChildFile (argv[++i]);
+        else if (! arg.startsWith ("--"))
+            inputFiles.add (File::getCurrentWorkingDirectory ().getChildFile (arg));
+        else
+            badArgument = true;
+    }
+
+    if (badArgument || inputFiles.size () == 0)
+    {
+        printUsage ();
+        return 1;
+    }
+
+    if (outputDirectory != File () && ! outputDirectory.createDirectory ())
+    {
+        std::cerr << "Couldn't create " << outputDirectory.getFullPathName () << std::endl;
+        return 1;
+    }
+
+    OfflineAnalyser::OutputFactory createOutput;
+
+    if (outputDirectory != File ())
+    {
+        createOutput = [&outputDirectory, encoding] (const File& file, const SpectrogramFile::Layout& layout)
+        {
+            const auto outputFile = outputDirectory.getChildFile (file.getFileNameWithoutExtension () + ".spectrogram");
+            std::unique_ptr<SpectrogramWriter> output (new SpectrogramWriter (outputFile, layout, encoding));
+
+            if (! output->openedOk ())
+            {
+                std::cerr << "Couldn't write " << outputFile.getFullPathName () << std::endl;
+                output.reset ();
+            }
+
+            return output;
+        };
+    }
+
+    const auto startTime = Time::getMillisecondCounterHiRes ();
+    Array<OfflineAnalyser::Result> results;
+
+    if (numThreads == 1)
+    {
+        OfflineAnalyser offlineAnalyser (options);
+
+        for (auto& file : inputFiles)
+            results.add (offlineAnalyser.analyse (file, createOutput));
+    }
+    else
+    {
+        BatchAnalyser batchAnalyser (options, numThreads, segmentSeconds);
+        results = batchAnalyser.analyse (inputFiles, createOutput);
+    }
+
+    const auto elapsedSeconds = (Time::getMillisecondCounterHiRes () - startTime) / 1000.;
+    const auto numBins = (1 << options.fftOrder) / 2;
+
+    double totalAudioSeconds = 0.;
+    auto numFailed = 0;
+
+    for (auto i = 0; i < results.size (); ++i)
+    {
+        const auto& result = results.getReference (i);
+
+        if (! result.succeeded)
+        {
+            std::cerr << result.error << std::endl;
+            ++numFailed;
+            continue;
+        }
+
+        std::cout << inputFiles[i].getFileName () << ": "
+                  << result.numFrames << " frames of " << numBins << " bins, "
+                  << String (result.audioSeconds, 1) << " s of audio in " << String (result.elapsedSeconds, 3) << " s ("
+                  << String (result.getRealTimeFactor (), 1) << "x real time)" << std::endl;
+
+        totalAudioSeconds += result.audioSeconds;
+    }
+
+    if (elapsedSeconds > 0.)
+        std::cout << "Total: " << String (totalAudioSeconds, 1) << " s of audio in " << String (elapsedSeconds, 3) << " s on "
+                  << numThreads << (numThreads == 1 ? " thread (" : " threads (")
+                  << String (totalAudioSeconds / elapsedSeconds, 1) << "x real time)" << std::endl;
+
+    return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/*
+  ==============================================================================
+
+    OfflineAnalyser.h
+    Created: 16 Oct 2026 3:05:48pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "SpectrumAnalyser.h"
+#include "SpectrogramFile.h"
+
+/** Decodes an audio file and streams it through a SpectrumAnalyser as fast as the CPU
+    allows. Each block that's read is analysed straight away, so the analyser's ring
+    never has more than one block in it and nothing is ever dropped.
+*/
+class OfflineAnalyser
+{
+public:
+    struct Options
+    {
+        int fftOrder {12};
+        float overlap {0.75f};
+        FftEngine::Type engine {FftEngine::Type::realFft};
+        WindowFunction::Settings window;
+        Array<int> sources;         // the SpectrumAnalyser::Source values to analyse, the sum if empty
+        bool smoothed {false};      // write the ballistics output rather than the raw magnitudes
+        int blockSize {8192};
+        int maxNumChannels {2};
+    };
+
+    /** Returns where a file's frames should go, or nullptr to just time the analysis. */
+    using OutputFactory = std::function<std::unique_ptr<SpectrogramWriter> (const File&, const SpectrogramFile::Layout&)>;
+
+    struct Result
+    {
+        bool succeeded {false};
+        String error;
+
+        int64 numSamples {0};
+        int64 numFrames {0};
+        double audioSeconds {0.};
+        double elapsedSeconds {0.};
+
+        /** How many seconds of audio were analysed per second of wall clock time. */
+        double getRealTimeFactor () const
+        {
+            return elapsedSeconds > 0. ? audioSeconds / elapsedSeconds : 0.;
+        }
+    };
+
+    explicit OfflineAnalyser (const Options& optionsToUse) :
+        options (optionsToUse),
+        analyser (optionsToUse.fftOrder, optionsToUse.maxNumChannels)
+    {
+        formatManager.registerBasicFormats ();
+        configure (analyser, options);
+    }
+
+    /** Sets an analyser up as the options say. */
+    static void configure (SpectrumAnalyser& analyserToConfigure, const Options& optionsToUse)
+    {
+        analyserToConfigure.setOverlap (optionsToUse.overlap);
+        analyserToConfigure.setFftEngine (optionsToUse.engine);
+        analyserToConfigure.setWindow (optionsToUse.window);
+
+        if (optionsToUse.sources.size () > 0)
+        {
+            analyserToConfigure.setSourceEnabled (SpectrumAnalyser::sumSource, false);
+
+            for (auto source : optionsToUse.sources)
+                if (source >= 0 && source < analyserToConfigure.getNumSources ())
+                    analyserToConfigure.setSourceEnabled (source, true);
+        }
+    }
+
+    /** Returns the layout of the frames a configured analyser produces: a slot for each
+        enabled source, in Source order.
+    */
+    static SpectrogramFile::Layout getLayout (const SpectrumAnalyser& configuredAnalyser, double sampleRate)
+    {
+        SpectrogramFile::Layout layout;
+        layout.sampleRate = sampleRate;
+        layout.fftSize = configuredAnalyser.getFftSize ();
+        layout.hopSize = configuredAnalyser.getHopSize ();
+
+        for (auto source = 0; source < configuredAnalyser.getNumSources (); ++source)
+            if (configuredAnalyser.isSourceEnabled (source))
+                layout.sources.add (source);
+
+        return layout;
+    }
+
+    /** Analyses a whole file, streaming each frame into the writer that createOutput
+        returns for it. A source that can't be made from the file's channels is written
+        as zeros.
+    */
+    Result analyse (const File& file, const OutputFactory& createOutput)
+    {
+        Result result;
+
+        std::unique_ptr<AudioFormatReader> reader (formatManager.createReaderFor (file));
+
+        if (reader == nullptr)
+        {
+            result.error = "Couldn't open " + file.getFullPathName ();
+            return result;
+        }
+
+        const auto startTime = Time::getMillisecondCounterHiRes ();
+
+        const auto numChannels = jmin (static_cast<int> (reader->numChannels), analyser.getMaxNumChannels ());
+        buffer.setSize (numChannels, options.blockSize, false, false, true);
+        analyser.prepare (reader->sampleRate, options.blockSize);
+
+        const auto layout = getLayout (analyser, reader->sampleRate);
+        auto output = createOutput != nullptr ? createOutput (file, layout) : nullptr;
+
+        const auto writeFrame = [&output, &layout, this] (const SpectrumAnalyser::Frame& frame)
+        {
+            if (output != nullptr)
+                output->writeSource (frame.samplePosition, layout.sources.indexOf (frame.source),
+                                     options.smoothed ? frame.magnitudes : frame.rawMagnitudes);
+        };
+
+        for (int64 position = 0; position < reader->lengthInSamples;)
+        {
+            const auto numToRead = static_cast<int> (jmin (int64 (options.blockSize), reader->lengthInSamples - position));
+            reader->read (&buffer, 0, numToRead, position, true, numChannels > 1);
+
+            analyser.addSamples (buffer, 0, numToRead);
+            result.numFrames += analyser.perform (writeFrame);
+
+            position += numToRead;
+        }
+
+        output.reset ();
+
+        jassert (analyser.getInputStats ().numSamplesDropped == 0);
+
+        result.succeeded = true;
+        result.numSamples = reader->lengthInSamples;
+        result.audioSeconds = static_cast<double> (reader->lengthInSamples) / reader->sampleRate;
+        result.elapsedSeconds = (Time::getMillisecondCounterHiRes () - startTime) / 1000.;
+        return result;
+    }
+
+    int getNumBins () const
+    {
+        return analyser.getNumBins ();
+    }
+
+private:
+    Options options;
+    AudioFormatManager formatManager;
+    SpectrumAnalyser analyser;
+    AudioBuffer<float> buffer;
+
+    JUCE_DECLARE_NON_COPYABLE (OfflineAnalyser)
+};
@@ -0,0 +1,156 @@
+/*
+  ==============================================================================
+
+    BenchmarkRunner.h
+    Created: 16 Oct 2026 11:38:04pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AllocationGuard.h"
+
+/** Times a piece of work one frame at a time and summarises it.
+
+    Each case runs a few untimed frames to warm the caches and let anything lazily
+    allocated settle, then times frames one by one until it has both enough frames and
+    enough time for the percentiles to be stable. The results go to the console as a
+    table and into a JSON array that can be diffed against a baseline run.
+
+    Allocations are counted by AllocationGuard's hooks, which see malloc, calloc and
+    realloc as well as operator new where the platform allows, so HeapBlock, AudioBuffer
+    and Array growing in a case are counted too. Each result records which allocators
+    were counted.
+*/
+class BenchmarkRunner
+{
+public:
+    struct Options
+    {
+        double secondsPerCase {0.25};
+        int minNumFrames {50};
+        int maxNumFrames {20000};
+        int numWarmupFrames {10};
+        String filter;      // only run cases whose name contains this
+    };
+
+    struct Result
+    {
+        String name;
+        int64 numFrames {0};
+        double nsPerFrame {0.};
+        double p50Ns {0.};
+        double p99Ns {0.};
+        double allocationsPerFrame {0.};
+        String countedAllocators;
+
+        double getFramesPerSecond () const
+        {
+            return nsPerFrame > 0. ? 1.0e9 / nsPerFrame : 0.;
+        }
+
+        var toVar () const
+        {
+            auto* object = new DynamicObject ();
+            object->setProperty ("name", name);
+            object->setProperty ("frames", numFrames);
+            object->setProperty ("nsPerFrame", nsPerFrame);
+            object->setProperty ("framesPerSecond", getFramesPerSecond ());
+            object->setProperty ("p50Ns", p50Ns);
+            object->setProperty ("p99Ns", p99Ns);
+            object->setProperty ("allocationsPerFrame", allocationsPerFrame);
+            object->setProperty ("countedAllocators", countedAllocators);
+            return var (object);
+        }
+    };
+
+    explicit BenchmarkRunner (const Options& optionsToUse) :
+        options (optionsToUse)
+    {
+        std::cout << "allocations counted: " << AllocationGuard::getHookedAllocators () << std::endl << std::endl;
+        std::cout << String ("case").paddedRight (' ', 44) << String ("ns/frame").paddedLeft (' ', 12)
+                  << String ("frames/s").paddedLeft (' ', 12) << String ("p50 ns").paddedLeft (' ', 12)
+                  << String ("p99 ns").paddedLeft (' ', 12) << String ("allocs").paddedLeft (' ', 8) << std::endl;
+    }
+
+    /** Runs frame () repeatedly and records how long each call took. Any setup belongs
+        outside frame (), so only the work being measured is timed. Returns false if the
+        filter skipped the case.
+    */
+    template <typename FrameFunction>
+    bool run (const String& name, FrameFunction&& frame)
+    {
+        if (options.filter.isNotEmpty () && ! name.contains (options.filter))
+            return false;
+
+        for (auto i = 0; i < options.numWarmupFrames; ++i)
+            frame ();
+
+        // Reserved before the allocation count starts, so the timings don't count themselves
+        std::vector<int64> ticks;
+        ticks.reserve (static_cast<size_t> (options.maxNumFrames));
+
+        const auto ticksPerSecond = static_cast<double> (Time::getHighResolutionTicksPerSecond ());
+        const auto minTicks = static_cast<int64> (options.secondsPerCase * ticksPerSecond);
+        const auto allocationsBefore = AllocationGuard::getNumAllocations ();
+        auto totalTicks = int64 (0);
+
+        while (static_cast<int> (ticks.size ()) < options.maxNumFrames
+                && (static_cast<int> (ticks.size ()) < options.minNumFrames || totalTicks < minTicks))
+        {
+            const auto start = Time::getHighResolutionTicks ();
+            frame ();
+            const auto elapsed = Time::getHighResolutionTicks () - start;
+
+            ticks.push_back (elapsed);
+            totalTicks += elapsed;
+        }
+
+        const auto numAllocations = AllocationGuard::getNumAllocations () - allocationsBefore;
+        const auto nsPerTick = 1.0e9 / ticksPerSecond;
+
+        Result result;
+        result.name = name;
+        result.numFrames = static_cast<int64> (ticks.size ());
+        result.nsPerFrame = static_cast<double> (totalTicks) * nsPerTick / static_cast<double> (result.numFrames);
+        result.allocationsPerFrame = static_cast<double> (numAllocations) / static_cast<double> (result.numFrames);
+        result.countedAllocators = AllocationGuard::getHookedAllocators ();
+
+        std::sort (ticks.begin (), ticks.end ());
+        result.p50Ns = static_cast<double> (getPercentile (ticks, 0.5)) * nsPerTick;
+        result.p99Ns = static_cast<double> (getPercentile (ticks, 0.99)) * nsPerTick;
+
+        print (result);
+        results.append (result.toVar ());
+        return true;
+    }
+
+    /** Returns every result so far, as a JSON array. */
+    const var& getResults () const noexcept
+    {
+        return results;
+    }
+
+private:
+    static int64 getPercentile (const std::vector<int64>& sortedTicks, double proportion)
+    {
+        const auto index = static_cast<size_t> (proportion * static_cast<double> (sortedTicks.size () - 1) + 0.5);
+        return sortedTicks[index];
+    }
+
+    static void print (const Result& result)
+    {
+        std::cout << result.name.paddedRight (' ', 44)
+                  << String (result.nsPerFrame, 0).paddedLeft (' ', 12)
+                  << String (result.getFramesPerSecond (), 0).paddedLeft (' ', 12)
+                  << String (result.p50Ns, 0).paddedLeft (' ', 12)
+                  << String (result.p99Ns, 0).paddedLeft (' ', 12)
+                  << String (result.allocationsPerFrame, 2).paddedLeft (' ', 8) << std::endl;
+    }
+
+    const Options options;
+    var results {Array<var> ()};
+};
@@ -0,0 +1,286 @@
+/*
+  ==============================================================================
+
+    Benchmarks.h
+    Created: 16 Oct 2026 11:52:47pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "BenchmarkRunner.h"
+#include "SpectrumAnalyser.h"
+#include "Ballistics.h"
+#include "BinMapping.h"
+#include "VisualizerComponent.h"
+
+/** The hot paths of the analysis and the display, each measured on its own so a change
+    to one shows up in its own numbers. Everything is drawn into software images, so the
+    suite needs no window and no GPU.
+*/
+namespace Benchmarks
+{
+    static const int graphHeight = 400;
+
+    static std::vector<int> getFftOrders ()     { return { 8, 10, 12, 14, 16 }; }
+    static std::vector<int> getChannelCounts () { return { 1, 2, 8 }; }
+    static std::vector<int> getWidths ()        { return { 800, 1920, 3840 }; }
+
+    /** A spectrum in the display's 0 to 1 range, falling with frequency with some peaks,
+        different for each seed so that nothing can be cached between frames.
+    */
+    static void makeDisplayValues (float* values, int numValues, int seed)
+    {
+        Random random (seed);
+
+        for (auto i = 0; i < numValues; ++i)
+        {
+            const auto pos = static_cast<float> (i) / static_cast<float> (numValues);
+            const auto peak = std::sin (pos * 40.f + static_cast<float> (seed));
+            values[i] = jlimit (0.f, 1.f, 0.8f - 0.5f * pos + 0.1f * peak * peak + 0.05f * random.nextFloat ());
+        }
+    }
+
+    /** Magnitudes as the analyser produces them, spread over about 100 dB. */
+    static void makeMagnitudes (float* magnitudes, int numBins, int seed)
+    {
+        makeDisplayValues (magnitudes, numBins, seed);
+
+        for (auto i = 0; i < numBins; ++i)
+            magnitudes[i] = Decibels::decibelsToGain (100.f * (magnitudes[i] - 1.f));
+    }
+
+    /** Adding a hop of samples and analysing the frame it completes, with the sum enabled. */
+    static void runAnalysis (BenchmarkRunner& runner)
+    {
+        for (auto order : getFftOrders ())
+        {
+            for (auto numChannels : getChannelCounts ())
+            {
+                SpectrumAnalyser analyser (order, numChannels);
+                analyser.setOverlap (0.75f);
+
+                const auto hop = analyser.getHopSize ();
+                analyser.prepare (48000., hop);
+
+                AudioBuffer<float> noise (numChannels, 1 << 16);
+                Random random (order * 100 + numChannels);
+
+                for (auto channel = 0; channel < numChannels; ++channel)
+                    for (auto i = 0; i < noise.getNumSamples (); ++i)
+                        noise.setSample (channel, i, random.nextFloat () * 2.f - 1.f);
+
+                auto position = 0;
+
+                runner.run ("analysis/order=" + String (order) + "/channels=" + String (numChannels), [&] ()
+                {
+                    if (position + hop > noise.getNumSamples ())
+                        position = 0;
+
+                    analyser.addSamples (noise, position, hop);
+                    position += hop;
+
+                    analyser.perform ([] (const SpectrumAnalyser::Frame&) {});
+                });
+            }
+        }
+    }
+
+    /** The same, with the constant-Q analysis from 20 Hz at a hop of 1024, for comparing
+        with the fft orders that would be needed for its resolution at the bottom.
+    */
+    static void runConstantQ (BenchmarkRunner& runner)
+    {
+        for (auto binsPerOctave : { 12, 24, 48 })
+        {
+            SpectrumAnalyser analyser (12);
+            analyser.setOverlap (0.75f);
+
+            const auto hop = analyser.getHopSize ();
+            analyser.prepare (48000., hop);
+            analyser.setConstantQ ({ binsPerOctave, 20.f });
+            analyser.setTransform (SpectrumAnalyser::Transform::constantQ);
+
+            std::vector<float> noise (1 << 16);
+            Random random (binsPerOctave);
+
+            for (auto& sample : noise)
+                sample = random.nextFloat () * 2.f - 1.f;
+
+            auto position = 0;
+
+            runner.run ("analysis-cqt/bins-per-octave=" + String (binsPerOctave), [&] ()
+            {
+                if (position + hop > static_cast<int> (noise.size ()))
+                    position = 0;
+
+                analyser.addSamples (noise.data () + position, hop);
+                position += hop;
+
+                analyser.perform ([] (const SpectrumAnalyser::Frame&) {});
+            });
+        }
+    }
+
+    /** The smoothing and peak tracking of one frame, next to the per-bin loop it replaced. */
+    static void runBallistics (BenchmarkRunner& runner)
+    {
+        using Vec = dsp::SIMDRegister<float>;
+
+        for (auto order : getFftOrders ())
+        {
+            const auto numBins = (1 << order) / 2;
+            const auto hop = (1 << order) / 4;
+
+            // Two frames to alternate between, so peaks keep being set and released
+            std::vector<float> storage (static_cast<size_t> (2 * numBins) + Vec::SIMDNumElements);
+            auto* frames = Vec::getNextSIMDAlignedPtr (storage.data ());
+            makeMagnitudes (frames, numBins, 1);
+            makeMagnitudes (frames + numBins, numBins, 2);
+
+            Ballistics ballistics;
+            ballistics.prepare (numBins);
+            ballistics.setTiming ({}, hop / 48000.);
+            auto frame = 0;
+
+            runner.run ("ballistics/bins=" + String (numBins), [&] ()
+            {
+                ballistics.process (frames + numBins * (++frame & 1));
+            });
+
+            const auto releaseGain = Decibels::decibelsToGain (-40.f * static_cast<float> (hop) / 48000.f);
+            ballistics.reset ();
+
+            runner.run ("ballistics-reference/bins=" + String (numBins), [&] ()
+            {
+                ballistics.processReference (frames + numBins * (++frame & 1), releaseGain);
+            });
+        }
+    }
+
+    /** Converting a spectrum to dB and mapping it onto a graph's pixels, as
+        VisualizerComponent::updateRenderBuffer () and the fft thread's displays do.
+    */
+    static void runDisplayConversion (BenchmarkRunner& runner)
+    {
+        for (auto order : { 12, 16 })
+        {
+            const auto numBins = (1 << order) / 2;
+            std::vector<float> magnitudes (static_cast<size_t> (numBins));
+            std::vector<float> decibels (static_cast<size_t> (numBins));
+            makeMagnitudes (magnitudes.data (), numBins, 1);
+
+            for (auto width : getWidths ())
+            {
+                BinMapping mapping;
+                mapping.update (width, numBins);
+                std::vector<float> pixels (static_cast<size_t> (width));
+
+                runner.run ("display/bins=" + String (numBins) + "/width=" + String (width), [&] ()
+                {
+                    BinMapping::toRelativeDecibels (magnitudes.data (), decibels.data (), numBins);
+                    mapping.render (decibels.data (), pixels.data ());
+                });
+            }
+        }
+    }
+
+    /** The largest difference in any colour channel between two images of the same size. */
+    static int getLargestDifference (const Image& first, const Image& second)
+    {
+        auto largest = 0;
+
+        for (auto y = 0; y < first.getHeight (); ++y)
+        {
+            for (auto x = 0; x < first.getWidth (); ++x)
+            {
+                const auto a = first.getPixelAt (x, y);
+                const auto b = second.getPixelAt (x, y);
+
+                largest = jmax (largest,
+                                std::abs (a.getRed () - b.getRed ()),
+                                std::abs (a.getGreen () - b.getGreen ()),
+                                std::abs (a.getBlue () - b.getBlue ()));
+            }
+        }
+
+        return largest;
+    }
+
+    /** Drawing the fft graph, and the drawVerticalLine () per column it used to do. When
+        both run, the two images are compared, since the rasteriser has to look the same.
+    */
+    static void runFftGraph (BenchmarkRunner& runner)
+    {
+        for (auto width : getWidths ())
+        {
+            Image target (Image::RGB, width, graphHeight, true, SoftwareImageType ());
+            Image reference (Image::RGB, width, graphHeight, true, SoftwareImageType ());
+
+            VisualizerComponent::FftGraph graph;
+            graph.setSize (width, graphHeight);
+            makeDisplayValues (graph.renderBuffer.getWritePointer (0), width, 1);
+
+            const auto ranGraph = runner.run ("fft-graph/width=" + String (width), [&] ()
+            {
+                Graphics g (target);
+                graph.paint (g);
+            });
+
+            const auto* values = graph.renderBuffer.getReadPointer (0);
+
+            const auto ranReference = runner.run ("fft-graph-reference/width=" + String (width), [&] ()
+            {
+                Graphics g (reference);
+                g.setColour (Colours::black);
+                g.fillRect (reference.getBounds ());
+                g.setColour (Colours::whitesmoke.withAlpha (0.2f));
+
+                for (auto x = 0; x < width; ++x)
+                    g.drawVerticalLine (x, graphHeight - values[x] * graphHeight, static_cast<float> (graphHeight));
+            });
+
+            if (ranGraph && ranReference)
+                std::cout << "    largest difference from the reference: " << getLargestDifference (target, reference) << "/255" << std::endl;
+        }
+    }
+
+    /** A new max arriving at the max graph, and the graph drawing it. */
+    static void runMaxGraph (BenchmarkRunner& runner)
+    {
+        for (auto width : getWidths ())
+        {
+            Image target (Image::ARGB, width, graphHeight, true, SoftwareImageType ());
+
+            VisualizerComponent::MaxGraph graph;
+            graph.setSize (width, graphHeight);
+
+            AudioBuffer<float> maxima (2, width);
+            makeDisplayValues (maxima.getWritePointer (0), width, 1);
+            makeDisplayValues (maxima.getWritePointer (1), width, 2);
+            auto frame = 0;
+
+            runner.run ("max-graph/width=" + String (width), [&] ()
+            {
+                graph.renderBuffer.copyFrom (0, 0, maxima, ++frame & 1, 0, width);
+                graph.update ();
+
+                Graphics g (target);
+                graph.paint (g);
+            });
+        }
+    }
+
+    static void runAll (BenchmarkRunner& runner)
+    {
+        runAnalysis (runner);
+        runConstantQ (runner);
+        runBallistics (runner);
+        runDisplayConversion (runner);
+        runFftGraph (runner);
+        runMaxGraph (runner);
+    }
+}
@@ -0,0 +1,120 @@
+/*
+  ==============================================================================
+
+    EngineTests.h
+    Created: 17 Oct 2026 3:14:52am
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SpectrumAnalyser.h"
+
+/** Checks the built in RealFftEngine against dsp::FFT at every order the analyser can use,
+    on white noise and on sines on a bin, between bins and close to Nyquist.
+
+    The two transforms round differently, so their magnitudes never match exactly. Each
+    bin's difference is taken relative to the largest magnitude in dsp::FFT's spectrum,
+    which is what the rounding error of either transform grows with, and the worst bin has
+    to come in under relativeTolerance.
+*/
+namespace EngineTests
+{
+    static constexpr float relativeTolerance = 1.0e-5f;
+
+    using FillFunction = std::function<void (float* samples, int size)>;
+
+    static FillFunction makeNoise (int seed)
+    {
+        return [seed] (float* samples, int size)
+        {
+            Random random (seed);
+
+            for (auto i = 0; i < size; ++i)
+                samples[i] = 2.f * random.nextFloat () - 1.f;
+        };
+    }
+
+    /** A sine at a frequency in cycles per sample. Multiples of 1/256 land on a bin at every order. */
+    static FillFunction makeSine (double frequency)
+    {
+        return [frequency] (float* samples, int size)
+        {
+            for (auto i = 0; i < size; ++i)
+                samples[i] = static_cast<float> (0.5 * std::sin (MathConstants<double>::twoPi * frequency * i));
+        };
+    }
+
+    /** Returns the worst difference between the two engines' magnitudes for one input,
+        relative to the largest of dsp::FFT's.
+    */
+    static float getWorstError (int order, const FillFunction& fill)
+    {
+        const auto size = 1 << order;
+        const auto numBins = size / 2 + 1;
+
+        // Both transforms work in place in a buffer of twice the fft size
+        std::vector<float> expected (static_cast<size_t> (2 * size), 0.f);
+        std::vector<float> actual (static_cast<size_t> (2 * size), 0.f);
+        fill (expected.data (), size);
+        std::copy (expected.begin (), expected.begin () + size, actual.begin ());
+
+        dsp::FFT reference (order);
+        reference.performFrequencyOnlyForwardTransform (expected.data ());
+
+        RealFftEngine engine (order);
+        engine.performFrequencyOnlyForwardTransform (actual.data ());
+
+        const auto peak = FloatVectorOperations::findMaximum (expected.data (), numBins);
+        auto worstDifference = 0.f;
+
+        for (auto bin = 0; bin < numBins; ++bin)
+            worstDifference = jmax (worstDifference, std::abs (actual[static_cast<size_t> (bin)] - expected[static_cast<size_t> (bin)]));
+
+        return peak > 0.f ? worstDifference / peak : worstDifference;
+    }
+
+    /** Runs every case, printing a line for each, and returns how many failed. */
+    static int runAll ()
+    {
+        struct Input
+        {
+            const char* name;
+            FillFunction fill;
+        };
+
+        const Input inputs[] = { { "noise seed 1",          makeNoise (1) },
+                                 { "noise seed 2",          makeNoise (2) },
+                                 { "sine on a bin",         makeSine (10. / 256.) },
+                                 { "sine between bins",     makeSine (37.3 / 256.) },
+                                 { "sine near nyquist",     makeSine (127.3 / 256.) } };
+
+        std::cout << String ("case").paddedRight (' ', 44) << String ("error").paddedLeft (' ', 12) << std::endl;
+
+        auto numFailures = 0;
+
+        for (auto order = SpectrumAnalyser::minFftOrder; order <= SpectrumAnalyser::maxFftOrder; ++order)
+        {
+            for (auto& input : inputs)
+            {
+                const auto error = getWorstError (order, input.fill);
+                const auto passed = error <= relativeTolerance;
+
+                if (! passed)
+                    ++numFailures;
+
+                std::cout << ("realFft/order=" + String (order) + "/" + input.name).paddedRight (' ', 44)
+                          << String (error, 9).paddedLeft (' ', 12)
+                          << (passed ? "" : "  FAILED") << std::endl;
+            }
+        }
+
+        std::cout << std::endl << (numFailures == 0 ? String ("All passed") : String (numFailures) + " failed")
+                  << ", tolerance " << String (relativeTolerance, 9) << " of the peak magnitude" << std::endl;
+
+        return numFailures;
+    }
+}
@@ -0,0 +1,145 @@
+/*
+  ==============================================================================
+
+    This file was auto-generated!
+
+    It contains the basic startup code for a JUCE application.
+
+  ==============================================================================
+*/
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "Benchmarks.h"
+#include "EngineTests.h"
+
+//==============================================================================
+static void printUsage ()
+{
+    std::cout << "Usage: FFTBenchmark [options]" << std::endl
+              << std::endl
+              << "  --test            check the fft engines against dsp::FFT instead of timing anything" << std::endl
+              << "  --filter text     only run cases whose name contains text, e.g. analysis/order=12" << std::endl
+              << "  --quick           time each case for 50 ms rather than 250 ms" << std::endl
+              << "  --output file     write the results to file as JSON" << std::endl
+              << "  --baseline file   compare the results with a previous --output file" << std::endl
+              << "  --threshold pct   how much slower than the baseline counts as a regression (default 10)" << std::endl;
+}
+
+/** Prints how each case compares with the baseline, returning the number that got slower
+    by more than the threshold, by mean or by p99.
+*/
+static int compareWithBaseline (const var& results, const var& baseline, double thresholdPercent)
+{
+    std::map<String, var> baselineCases;
+
+    if (auto* cases = baseline.getArray ())
+        for (auto& c : *cases)
+            baselineCases[c["name"].toString ()] = c;
+
+    const auto getChange = [] (const var& now, const var& before, const char* property)
+    {
+        const auto previous = static_cast<double> (before[property]);
+        return previous > 0. ? 100. * (static_cast<double> (now[property]) - previous) / previous : 0.;
+    };
+
+    std::cout << std::endl << String ("case").paddedRight (' ', 44) << String ("mean").paddedLeft (' ', 10)
+              << String ("p99").paddedLeft (' ', 10) << String ("allocs").paddedLeft (' ', 10) << std::endl;
+
+    auto numRegressions = 0;
+
+    for (auto& result : *results.getArray ())
+    {
+        const auto name = result["name"].toString ();
+        const auto found = baselineCases.find (name);
+
+        if (found == baselineCases.end ())
+        {
+            std::cout << name.paddedRight (' ', 44) << "  (not in baseline)" << std::endl;
+            continue;
+        }
+
+        const auto meanChange = getChange (result, found->second, "nsPerFrame");
+        const auto p99Change = getChange (result, found->second, "p99Ns");
+        // Counts from builds that hooked different allocators can't be compared
+        const auto sameAllocators = result["countedAllocators"] == found->second["countedAllocators"];
+        const auto allocationChange = sameAllocators ? static_cast<double> (result["allocationsPerFrame"]) - static_cast<double> (found->second["allocationsPerFrame"])
+                                                     : 0.;
+        const auto regressed = meanChange > thresholdPercent || p99Change > thresholdPercent || allocationChange > 0.;
+
+        if (regressed)
+            ++numRegressions;
+
+        std::cout << name.paddedRight (' ', 44)
+                  << (String (meanChange, 1) + "%").paddedLeft (' ', 10)
+                  << (String (p99Change, 1) + "%").paddedLeft (' ', 10)
+                  << (sameAllocators ? String (allocationChange, 2) : String ("n/a")).paddedLeft (' ', 10)
+                  << (regressed ? "  REGRESSED" : "") << std::endl;
+    }
+
+    return numRegressions;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    // The graphs are Components, which expect the message manager to exist
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    BenchmarkRunner::Options options;
+    File outputFile;
+    File baselineFile;
+    auto thresholdPercent = 10.;
+    auto runTests = false;
+
+    for (auto i = 1; i < argc; ++i)
+    {
+        const String arg (argv[i]);
+        const auto hasValue = i + 1 < argc;
+
+        if (arg == "--test")
+            runTests = true;
+        else if (arg == "--filter" && hasValue)
+            options.filter = argv[++i];
+        else if (arg == "--quick")
+            options.secondsPerCase = 0.05;
+        else if (arg == "--output" && hasValue)
+            outputFile = File::getCurrentWorkingDirectory ().getChildFile (argv[++i]);
+        else if (arg == "--baseline" && hasValue)
+            baselineFile = File::getCurrentWorkingDirectory ().getChildFile (argv[++i]);
+        else if (arg == "--threshold" && hasValue)
+            thresholdPercent = jmax (0., String (argv[++i]).getDoubleValue ());
+        else
+        {
+            printUsage ();
+            return 1;
+        }
+    }
+
+    if (runTests)
+        return EngineTests::runAll () > 0 ? 1 : 0;
+
+    BenchmarkRunner runner (options);
+    Benchmarks::runAll (runner);
+
+    if (outputFile != File () && ! outputFile.replaceWithText (JSON::toString (runner.getResults ())))
+    {
+        std::cerr << "Couldn't write " << outputFile.getFullPathName () << std::endl;
+        return 1;
+    }
+
+    if (baselineFile != File ())
+    {
+        const auto baseline = JSON::parse (baselineFile);
+
+        if (! baseline.isArray ())
+        {
+            std::cerr << "Couldn't read " << baselineFile.getFullPathName () << std::endl;
+            return 1;
+        }
+
+        if (compareWithBaseline (runner.getResults (), baseline, thresholdPercent) > 0)
+            return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+/*
+  ==============================================================================
+
+    AllocationGuard.cpp
+    Created: 17 Oct 2026 12:21:05am
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#include "AllocationGuard.h"
+
+#if FFTVISUALIZER_HOOKS_MALLOC
+
+// operator new calls malloc on all of these, so hooking malloc, calloc and realloc sees
+// every allocation, whether it came from new or from HeapBlock.
+
+ #if JUCE_LINUX
+
+// glibc's own entry points, which its malloc, calloc and realloc are aliases for. Defining
+// malloc, calloc and realloc in the executable puts them in front of glibc's for the whole
+// process, and they hand the work straight back, so free () and everything else still match.
+extern "C" void* __libc_malloc (size_t);
+extern "C" void* __libc_calloc (size_t, size_t);
+extern "C" void* __libc_realloc (void*, size_t);
+
+extern "C" void* malloc (size_t size) noexcept
+{
+    AllocationGuard::noteAllocation ();
+    return __libc_malloc (size);
+}
+
+extern "C" void* calloc (size_t num, size_t size) noexcept
+{
+    AllocationGuard::noteAllocation ();
+    return __libc_calloc (num, size);
+}
+
+extern "C" void* realloc (void* memory, size_t size) noexcept
+{
+    // Shrinking to nothing is a free, which is allowed anywhere
+    if (size > 0)
+        AllocationGuard::noteAllocation ();
+
+    return __libc_realloc (memory, size);
+}
+
+ #elif JUCE_MAC
+
+  #include <malloc/malloc.h>
+  #include <mach/mach.h>
+
+namespace
+{
+    // The default zone's own functions, which the hooks hand the work on to
+    void* (*zoneMalloc) (malloc_zone_t*, size_t) = nullptr;
+    void* (*zoneCalloc) (malloc_zone_t*, size_t, size_t) = nullptr;
+    void* (*zoneRealloc) (malloc_zone_t*, void*, size_t) = nullptr;
+
+    void* hookedMalloc (malloc_zone_t* zone, size_t size)
+    {
+        AllocationGuard::noteAllocation ();
+        return zoneMalloc (zone, size);
+    }
+
+    void* hookedCalloc (malloc_zone_t* zone, size_t num, size_t size)
+    {
+        AllocationGuard::noteAllocation ();
+        return zoneCalloc (zone, num, size);
+    }
+
+    void* hookedRealloc (malloc_zone_t* zone, void* memory, size_t size)
+    {
+        if (size > 0)
+            AllocationGuard::noteAllocation ();
+
+        return zoneRealloc (zone, memory, size);
+    }
+
+    /** malloc, calloc and realloc all go through the default zone, so this swaps its
+        functions for ones that call noteAllocation () first. The zone has been read only
+        since 10.7, so it's made writable while they're swapped.
+    */
+    struct DefaultZoneHook
+    {
+        DefaultZoneHook ()
+        {
+            auto* zone = malloc_default_zone ();
+            const auto address = reinterpret_cast<vm_address_t> (zone);
+
+            if (vm_protect (mach_task_self (), address, sizeof (malloc_zone_t), 0, VM_PROT_READ | VM_PROT_WRITE) != KERN_SUCCESS)
+            {
+                jassertfalse;   // the guards will only see operator new
+                return;
+            }
+
+            zoneMalloc = zone->malloc;
+            zoneCalloc = zone->calloc;
+            zoneRealloc = zone->realloc;
+
+            zone->malloc = hookedMalloc;
+            zone->calloc = hookedCalloc;
+            zone->realloc = hookedRealloc;
+
+            vm_protect (mach_task_self (), address, sizeof (malloc_zone_t), 0, VM_PROT_READ);
+        }
+    };
+
+    const DefaultZoneHook defaultZoneHook;
+}
+
+ #elif JUCE_WINDOWS
+
+  #include <crtdbg.h>
+
+namespace
+{
+    _CRT_ALLOC_HOOK previousHook = nullptr;
+
+    int __cdecl allocationHook (int allocationType, void* userData, size_t size, int blockType,
+                                long requestNumber, const unsigned char* fileName, int lineNumber)
+    {
+        // The CRT's own blocks are left out, as they are from its leak reports
+        if ((allocationType == _HOOK_ALLOC || allocationType == _HOOK_REALLOC) && blockType != _CRT_BLOCK)
+            AllocationGuard::noteAllocation ();
+
+        if (previousHook != nullptr)
+            return previousHook (allocationType, userData, size, blockType, requestNumber, fileName, lineNumber);
+
+        return TRUE;
+    }
+
+    /** The debug CRT calls this before every malloc, calloc and realloc. */
+    struct CrtAllocationHook
+    {
+        CrtAllocationHook ()
+        {
+            previousHook = _CrtSetAllocHook (allocationHook);
+        }
+    };
+
+    const CrtAllocationHook crtAllocationHook;
+}
+
+ #endif
+
+#elif FFTVISUALIZER_CHECK_ALLOCATIONS
+
+// Without a malloc hook, every allocation made with new still comes through here, so
+// AllocationGuard can catch the ones made on a thread that holds a ScopedNoAllocation.
+// Calls straight to malloc, like HeapBlock's, aren't seen.
+void* operator new (std::size_t size)
+{
+    AllocationGuard::noteAllocation ();
+
+    if (auto* memory = std::malloc (size > 0 ? size : 1))
+        return memory;
+
+    throw std::bad_alloc ();
+}
+
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept
+{
+    AllocationGuard::noteAllocation ();
+    return std::malloc (size > 0 ? size : 1);
+}
+
+void* operator new[] (std::size_t size)                                     { return operator new (size); }
+void* operator new[] (std::size_t size, const std::nothrow_t& tag) noexcept { return operator new (size, tag); }
+
+void operator delete (void* memory) noexcept                                { std::free (memory); }
+void operator delete[] (void* memory) noexcept                              { std::free (memory); }
+void operator delete (void* memory, std::size_t) noexcept                   { std::free (memory); }
+void operator delete[] (void* memory, std::size_t) noexcept                 { std::free (memory); }
+void operator delete (void* memory, const std::nothrow_t&) noexcept         { std::free (memory); }
+void operator delete[] (void* memory, const std::nothrow_t&) noexcept       { std::free (memory); }
+
+#endif
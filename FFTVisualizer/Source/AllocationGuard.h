@@ -0,0 +1,260 @@
+/*
+  ==============================================================================
+
+    AllocationGuard.h
+    Created: 17 Oct 2026 12:21:05am
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** Set this to 1 to check release builds too. With it at 0 the guards compile to nothing. */
+#ifndef FFTVISUALIZER_CHECK_ALLOCATIONS
+ #if JUCE_DEBUG
+  #define FFTVISUALIZER_CHECK_ALLOCATIONS 1
+ #else
+  #define FFTVISUALIZER_CHECK_ALLOCATIONS 0
+ #endif
+#endif
+
+/** 1 where AllocationGuard.cpp hooks malloc, calloc and realloc themselves: glibc's Linux,
+    macOS, and Windows with the debug CRT. Elsewhere it only replaces operator new.
+*/
+#if FFTVISUALIZER_CHECK_ALLOCATIONS && ((JUCE_LINUX && defined (__GLIBC__)) || JUCE_MAC || (JUCE_WINDOWS && defined (_DEBUG)))
+ #define FFTVISUALIZER_HOOKS_MALLOC 1
+#else
+ #define FFTVISUALIZER_HOOKS_MALLOC 0
+#endif
+
+/** Catches heap allocations on the threads that mustn't make them.
+
+    Code that has to stay off the heap, like the audio callback and the fft thread, holds
+    a ScopedNoAllocation while it runs. The hooks in AllocationGuard.cpp tell
+    noteAllocation () about every allocation, and any made while the calling thread holds
+    a guard are counted and, unless setAssertOnAllocation (false) was called, assert.
+    Apps that don't link AllocationGuard.cpp can still use the guards, they just never fire.
+
+    Where it can, AllocationGuard.cpp hooks malloc, calloc and realloc, so the guard also
+    sees what HeapBlock, and so AudioBuffer, Array, OwnedArray and Path, allocate. Where
+    it can't (see FFTVISUALIZER_HOOKS_MALLOC) only operator new is seen, and
+    getHookedAllocators () says so.
+*/
+struct AllocationGuard
+{
+    class ScopedNoAllocation
+    {
+    public:
+        ScopedNoAllocation () noexcept
+        {
+           #if FFTVISUALIZER_CHECK_ALLOCATIONS
+            ++getDepth ();
+           #endif
+        }
+
+        ~ScopedNoAllocation () noexcept
+        {
+           #if FFTVISUALIZER_CHECK_ALLOCATIONS
+            --getDepth ();
+           #endif
+        }
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedNoAllocation)
+    };
+
+    /** Lifts the guard for something that's allowed to allocate, like the first use of
+        something that has to be set up lazily. Keep these rare and say why at each one.
+    */
+    class ScopedAllowAllocation
+    {
+    public:
+        ScopedAllowAllocation () noexcept
+        {
+           #if FFTVISUALIZER_CHECK_ALLOCATIONS
+            std::swap (previousDepth, getDepth ());
+           #endif
+        }
+
+        ~ScopedAllowAllocation () noexcept
+        {
+           #if FFTVISUALIZER_CHECK_ALLOCATIONS
+            getDepth () = previousDepth;
+           #endif
+        }
+
+    private:
+       #if FFTVISUALIZER_CHECK_ALLOCATIONS
+        int previousDepth {0};
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedAllowAllocation)
+    };
+
+    static bool isAllocationForbidden () noexcept
+    {
+       #if FFTVISUALIZER_CHECK_ALLOCATIONS
+        return getDepth () > 0;
+       #else
+        return false;
+       #endif
+    }
+
+    /** Called by the hooks in AllocationGuard.cpp before every allocation. This runs inside
+        malloc, so it mustn't allocate itself unless it has lifted the guard.
+    */
+    static void noteAllocation () noexcept
+    {
+       #if FFTVISUALIZER_CHECK_ALLOCATIONS
+        getAllocationCounter ().fetch_add (1, std::memory_order_relaxed);
+
+        if (getDepth () == 0)
+            return;
+
+        getViolationCounter ().fetch_add (1, std::memory_order_relaxed);
+
+        if (getShouldAssert ().load (std::memory_order_relaxed))
+        {
+            // Logging the assertion may allocate, so it mustn't come back here
+            const ScopedAllowAllocation allowAllocation;
+            jassertfalse;
+        }
+       #endif
+    }
+
+    /** Returns how many allocations have been made under a guard, on any thread. */
+    static int64 getNumViolations () noexcept
+    {
+       #if FFTVISUALIZER_CHECK_ALLOCATIONS
+        return getViolationCounter ().load (std::memory_order_relaxed);
+       #else
+        return 0;
+       #endif
+    }
+
+    /** Returns how many allocations the hooks have seen, on any thread, guarded or not. */
+    static int64 getNumAllocations () noexcept
+    {
+       #if FFTVISUALIZER_CHECK_ALLOCATIONS
+        return getAllocationCounter ().load (std::memory_order_relaxed);
+       #else
+        return 0;
+       #endif
+    }
+
+    /** Describes which allocation functions the hooks see in this build, for anything
+        reporting the counts.
+    */
+    static const char* getHookedAllocators () noexcept
+    {
+       #if FFTVISUALIZER_HOOKS_MALLOC
+        return "malloc, calloc, realloc and operator new";
+       #elif FFTVISUALIZER_CHECK_ALLOCATIONS
+        return "operator new only";
+       #else
+        return "none";
+       #endif
+    }
+
+    /** Turn this off to only count violations, e.g. to survey a build before fixing them. */
+    static void setAssertOnAllocation (bool shouldAssert) noexcept
+    {
+       #if FFTVISUALIZER_CHECK_ALLOCATIONS
+        getShouldAssert () = shouldAssert;
+       #else
+        ignoreUnused (shouldAssert);
+       #endif
+    }
+
+private:
+   #if FFTVISUALIZER_CHECK_ALLOCATIONS
+    static int& getDepth () noexcept
+    {
+        static thread_local int depth = 0;
+        return depth;
+    }
+
+    static std::atomic<int64>& getAllocationCounter () noexcept
+    {
+        static std::atomic<int64> numAllocations {0};
+        return numAllocations;
+    }
+
+    static std::atomic<int64>& getViolationCounter () noexcept
+    {
+        static std::atomic<int64> numViolations {0};
+        return numViolations;
+    }
+
+    static std::atomic<bool>& getShouldAssert () noexcept
+    {
+        static std::atomic<bool> shouldAssert {true};
+        return shouldAssert;
+    }
+   #endif
+};
+
+//==============================================================================
+/** Storage for the temporaries of one frame, reserved up front so they never come from
+    the heap. Take blocks with allocate () while working on a frame and reset () before
+    the next one. Every block is aligned to a cache line, so it's also SIMD aligned.
+*/
+class ScratchArena
+{
+public:
+    /** Sizes the arena, discarding anything allocated from it. This allocates, so call it
+        before the real-time work starts.
+    */
+    void reserve (size_t numBytes)
+    {
+        storage.assign (numBytes + alignment, 0);
+
+        const auto address = reinterpret_cast<pointer_sized_uint> (storage.data ());
+        start = storage.data () + ((alignment - address % alignment) % alignment);
+        capacity = numBytes;
+        numBytesUsed = 0;
+    }
+
+    /** Returns room for num values, or nullptr if the arena was reserved too small. */
+    template <typename ValueType>
+    ValueType* allocate (int num) noexcept
+    {
+        const auto numBytes = static_cast<size_t> (jmax (0, num)) * sizeof (ValueType);
+        const auto alignedSize = (numBytes + alignment - 1) / alignment * alignment;
+
+        if (numBytesUsed + alignedSize > capacity)
+        {
+            jassertfalse;   // reserve () more
+            return nullptr;
+        }
+
+        auto* block = start + numBytesUsed;
+        numBytesUsed += alignedSize;
+        return reinterpret_cast<ValueType*> (block);
+    }
+
+    void reset () noexcept
+    {
+        numBytesUsed = 0;
+    }
+
+    /** The size of a block of num values once it's been rounded up for alignment, for working out what to reserve (). */
+    template <typename ValueType>
+    static size_t getSizeNeeded (int num) noexcept
+    {
+        return (static_cast<size_t> (jmax (0, num)) * sizeof (ValueType) + alignment - 1) / alignment * alignment;
+    }
+
+    size_t getNumBytesUsed () const noexcept    { return numBytesUsed; }
+    size_t getCapacity () const noexcept        { return capacity; }
+
+private:
+    static constexpr size_t alignment = 64;
+
+    std::vector<char> storage;
+    char* start {nullptr};
+    size_t capacity {0};
+    size_t numBytesUsed {0};
+};
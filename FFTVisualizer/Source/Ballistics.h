@@ -0,0 +1,194 @@
+/*
+  ==============================================================================
+
+    Ballistics.h
+    Created: 16 Oct 2026 11:02:37am
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** Applies attack and release smoothing to a magnitude spectrum and tracks a per-bin peak
+    with an optional hold time, all in a single branch-free pass over the bins.
+
+    The default settings match the original behaviour: rises are followed instantly,
+    falls decay at 40 dB per second, and peaks are held until clearMax () is called.
+*/
+class Ballistics
+{
+public:
+    struct Settings
+    {
+        float attackMs {0.f};                   // 0 follows rises instantly
+        float releaseDbPerSecond {40.f};
+        float peakHoldMs {-1.f};                // negative holds peaks until they're cleared
+        float peakReleaseDbPerSecond {20.f};    // how fast peaks fall once the hold has run out
+    };
+
+    /** Allocates the state for the given number of bins, call this before processing. */
+    void prepare (int newNumBins)
+    {
+        numBins = newNumBins;
+
+        // Each array starts on a register boundary, whatever the number of bins
+        const auto width = static_cast<int> (Vec::SIMDNumElements);
+        const auto stride = (numBins + width - 1) / width * width;
+        storage.assign (static_cast<size_t> (3 * stride + width), 0.f);
+
+        output = Vec::getNextSIMDAlignedPtr (storage.data ());
+        peaks = output + stride;
+        holds = peaks + stride;
+    }
+
+    void reset () noexcept
+    {
+        FloatVectorOperations::clear (output, static_cast<int> (holds - output) + numBins);
+    }
+
+    void clearMax () noexcept
+    {
+        FloatVectorOperations::clear (peaks, numBins);
+        FloatVectorOperations::clear (holds, numBins);
+    }
+
+    /** Works out the per-frame coefficients for frames that are secondsPerFrame apart. */
+    void setTiming (const Settings& settings, double secondsPerFrame) noexcept
+    {
+        const auto frameMs = static_cast<float> (1000. * secondsPerFrame);
+        const auto frameSeconds = static_cast<float> (secondsPerFrame);
+
+        attack = settings.attackMs > 0.f ? 1.f - std::exp (-frameMs / settings.attackMs) : 1.f;
+        release = Decibels::decibelsToGain (-settings.releaseDbPerSecond * frameSeconds);
+
+        if (settings.peakHoldMs < 0.f)
+        {
+            holdFrames = 0.f;
+            peakRelease = 1.f;
+        }
+        else
+        {
+            holdFrames = std::ceil (settings.peakHoldMs / frameMs);
+            peakRelease = Decibels::decibelsToGain (-settings.peakReleaseDbPerSecond * frameSeconds);
+        }
+    }
+
+    /** Processes one frame of magnitudes and returns how many bins set a new peak. */
+    int process (const float* input) noexcept
+    {
+        auto n = 0;
+        auto numChanged = 0;
+
+        if (Vec::isSIMDAligned (input))
+        {
+            n = numBins - numBins % static_cast<int> (Vec::SIMDNumElements);
+            numChanged = processSimd (input, n);
+        }
+
+        for (; n < numBins; ++n)
+            numChanged += processBin (input[n], output[n], peaks[n], holds[n]);
+
+        return numChanged;
+    }
+
+    /** The original per-bin loop, kept as the reference for the branch-free versions. */
+    int processReference (const float* input, float releaseGain) noexcept
+    {
+        auto numChanged = 0;
+
+        for (auto n = 0; n < numBins; ++n)
+        {
+            if (input[n] > output[n])
+                output[n] = input[n];
+            else
+                output[n] *= releaseGain;
+
+            if (input[n] > peaks[n])
+            {
+                peaks[n] = input[n];
+                ++numChanged;
+            }
+        }
+
+        return numChanged;
+    }
+
+    /** True if peaks fall on their own, so the max changes even when no new peak is set. */
+    bool peaksDecay () const noexcept           { return peakRelease < 1.f; }
+
+    int getNumBins () const noexcept            { return numBins; }
+    const float* getOutput () const noexcept    { return output; }
+    const float* getMax () const noexcept       { return peaks; }
+
+private:
+    using Vec = dsp::SIMDRegister<float>;
+    using Mask = Vec::vMaskType;
+
+    int processBin (float in, float& out, float& peak, float& hold) const noexcept
+    {
+        const auto rising = in > out;
+        out = rising ? in * attack + out * (1.f - attack) : out * release;
+
+        const auto newPeak = in > peak;
+        const auto decayedPeak = hold > 0.f ? peak : peak * peakRelease;
+        peak = newPeak ? in : decayedPeak;
+        hold = newPeak ? holdFrames : jmax (0.f, hold - 1.f);
+
+        return newPeak ? 1 : 0;
+    }
+
+    static Vec select (Mask mask, Vec ifTrue, Vec ifFalse) noexcept
+    {
+        return (ifTrue & mask) + (ifFalse & ~mask);
+    }
+
+    int processSimd (const float* input, int numToProcess) noexcept
+    {
+        const auto width = static_cast<int> (Vec::SIMDNumElements);
+
+        const auto vAttack = Vec::expand (attack);
+        const auto vAttackKeep = Vec::expand (1.f - attack);
+        const auto vRelease = Vec::expand (release);
+        const auto vPeakRelease = Vec::expand (peakRelease);
+        const auto vHoldFrames = Vec::expand (holdFrames);
+        const auto vZero = Vec::expand (0.f);
+        const auto vOne = Vec::expand (1.f);
+
+        auto changed = vZero;
+
+        for (auto n = 0; n < numToProcess; n += width)
+        {
+            const auto in = Vec::fromRawArray (input + n);
+            const auto out = Vec::fromRawArray (output + n);
+            const auto peak = Vec::fromRawArray (peaks + n);
+            const auto hold = Vec::fromRawArray (holds + n);
+
+            const auto rising = Vec::greaterThan (in, out);
+            select (rising, in * vAttack + out * vAttackKeep, out * vRelease).copyToRawArray (output + n);
+
+            const auto newPeak = Vec::greaterThan (in, peak);
+            const auto decayedPeak = select (Vec::greaterThan (hold, vZero), peak, peak * vPeakRelease);
+            select (newPeak, in, decayedPeak).copyToRawArray (peaks + n);
+            select (newPeak, vHoldFrames, Vec::max (hold - vOne, vZero)).copyToRawArray (holds + n);
+
+            changed = changed + (vOne & newPeak);
+        }
+
+        return static_cast<int> (changed.sum ());
+    }
+
+    int numBins {0};
+
+    std::vector<float> storage;
+    float* output {nullptr};
+    float* peaks {nullptr};
+    float* holds {nullptr};
+
+    float attack {1.f};
+    float release {1.f};
+    float holdFrames {0.f};
+    float peakRelease {1.f};
+};
@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    BinMapping.h
+    Created: 16 Oct 2026 7:12:36pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "Utilities.h"
+#include "FastDecibels.h"
+
+/** Maps fft bins onto a row of pixels on a log or linear frequency axis.
+
+    Working out where each pixel falls takes an exp and a log, so it's done once, when
+    the number of pixels, the number of bins or the scale changes, and kept as a table.
+    Where a bin is wider than a pixel, a pixel interpolates between the two bins around
+    it. Where a pixel covers several bins, it takes their max (so narrow peaks don't
+    disappear between pixels) or their mean.
+*/
+class BinMapping
+{
+public:
+    enum class Aggregation
+    {
+        max,
+        mean
+    };
+
+    enum class Scale
+    {
+        logarithmic,    // from bin 1 up, each octave the same width
+        linear          // from DC up, each bin the same width
+    };
+
+    /** How the bins themselves are spaced. Bins already spaced in log frequency, like the
+        constant-Q analysis's, are spread evenly across the pixels whatever the scale.
+    */
+    enum class BinSpacing
+    {
+        linear,
+        logarithmic
+    };
+
+    /** Rebuilds the table if the number of pixels, the number of bins, the scale or the bin spacing has changed. */
+    void update (int newNumPixels, int newNumBins, Scale newScale = Scale::logarithmic, BinSpacing newSpacing = BinSpacing::linear)
+    {
+        if (newNumPixels == numPixels && newNumBins == numBins && newScale == scale && newSpacing == spacing)
+            return;
+
+        numPixels = newNumPixels;
+        numBins = newNumBins;
+        scale = newScale;
+        spacing = newSpacing;
+        entries.resize (static_cast<size_t> (jmax (0, numPixels)));
+
+        const auto maxBin = static_cast<float> (numBins);
+        const auto isLogAxis = scale == Scale::logarithmic && spacing == BinSpacing::linear;
+        const auto getBinPos = [this, maxBin, isLogAxis] (int pixel)
+        {
+            const auto normPos = static_cast<float> (pixel) / static_cast<float> (numPixels);
+            return isLogAxis ? RangeUtils::normalizedToLogRange (normPos, 1.f, maxBin) : normPos * maxBin;
+        };
+
+        auto binPos = getBinPos (0);
+
+        for (auto i = 0; i < numPixels; ++i)
+        {
+            const auto nextBinPos = getBinPos (i + 1);
+
+            auto& entry = entries[static_cast<size_t> (i)];
+            entry.bin = jmin (static_cast<int> (std::floor (binPos)), numBins - 1);
+            entry.weight = binPos - static_cast<float> (entry.bin);
+            entry.numBins = jmin (static_cast<int> (std::floor (nextBinPos)), numBins) - entry.bin;
+
+            if (entry.numBins < 2)
+            {
+                entry.numBins = 1;
+                entry.nextBin = jmin (entry.bin + 1, numBins - 1);
+            }
+
+            binPos = nextBinPos;
+        }
+    }
+
+    /** Makes room for up to maxNumPixels, so that update () never allocates below that. */
+    void reserve (int maxNumPixels)
+    {
+        entries.reserve (static_cast<size_t> (jmax (0, maxNumPixels)));
+    }
+
+    void setAggregation (Aggregation newAggregation)    { aggregation = newAggregation; }
+    Aggregation getAggregation () const                 { return aggregation; }
+
+    int getNumPixels () const   { return numPixels; }
+    int getNumBins () const     { return numBins; }
+    Scale getScale () const     { return scale; }
+    BinSpacing getBinSpacing () const   { return spacing; }
+
+    /** Converts calibrated magnitudes to the display's relative dB: 0 for -100 dB full
+        scale or below, up to 1 for 0 dB.
+    */
+    static void toRelativeDecibels (const float* magnitudes, float* dB, int numBins)
+    {
+        FastDecibels::gainToRelativeDecibels (magnitudes, dB, numBins, 1.f);
+    }
+
+    /** Maps a spectrum in relative dB onto the pixels as the graphs draw it, with the
+        steps between pixels softened.
+    */
+    void render (const float* dB, float* pixelValues) const
+    {
+        apply (dB, pixelValues);
+
+        auto previousValue = dB[0];
+
+        for (auto i = 0; i < numPixels; ++i)
+        {
+            const auto smoothedValue = 0.5f * (previousValue + pixelValues[i]);
+            previousValue = smoothedValue;
+
+            pixelValues[i] = smoothedValue;
+        }
+    }
+
+    /** Fills numPixels values from numBins per bin values. */
+    void apply (const float* binValues, float* pixelValues) const
+    {
+        for (auto i = 0; i < numPixels; ++i)
+        {
+            const auto& entry = entries[static_cast<size_t> (i)];
+            const auto* values = binValues + entry.bin;
+
+            if (entry.numBins == 1)
+            {
+                pixelValues[i] = values[0] + entry.weight * (binValues[entry.nextBin] - values[0]);
+            }
+            else if (aggregation == Aggregation::max)
+            {
+                pixelValues[i] = FloatVectorOperations::findMaximum (values, entry.numBins);
+            }
+            else
+            {
+                auto sum = 0.f;
+
+                for (auto bin = 0; bin < entry.numBins; ++bin)
+                    sum += values[bin];
+
+                pixelValues[i] = sum / static_cast<float> (entry.numBins);
+            }
+        }
+    }
+
+private:
+    struct Entry
+    {
+        int bin {0};            // the lowest bin the pixel shows
+        int nextBin {0};        // the bin it interpolates towards, if it shows only one
+        int numBins {1};        // how many bins the pixel covers
+        float weight {0.f};     // how far the pixel is from bin towards nextBin
+    };
+
+    std::vector<Entry> entries;
+    int numPixels {0};
+    int numBins {0};
+    Scale scale {Scale::logarithmic};
+    BinSpacing spacing {BinSpacing::linear};
+    Aggregation aggregation {Aggregation::max};
+};
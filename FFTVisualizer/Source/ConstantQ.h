@@ -0,0 +1,330 @@
+/*
+  ==============================================================================
+
+    ConstantQ.h
+    Created: 17 Oct 2026 2:36:18am
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "FftEngine.h"
+
+/** A constant-Q analysis: bins evenly spaced in log frequency, each a fixed fraction of its
+    centre frequency wide, so every octave gets the same number of bins.
+
+    Rather than one huge fft, the input runs through a cascade of half-band decimators,
+    each halving the sample rate, and every stage is analysed with the same small fft.
+    Stage s sees a window 2^s times longer than the first, so the resolution follows the
+    bins down in frequency: the bottom octaves get the long windows they need without the
+    top octaves paying for them. Each bin is read from the most decimated stage that still
+    holds it cleanly, i.e. below a quarter of the stage's sample rate, which the half-band
+    filters keep free of aliases. It takes the max of the fft bins inside it, or
+    interpolates between the two around it where it's narrower than one.
+
+    A stage's fft only needs redoing once its window has moved on by an eighth, so the deep
+    stages are analysed rarely and each frame costs a few small ffts whatever the lowest
+    frequency. The price is time resolution at the bottom: for 24 bins per octave the
+    window for 20 Hz is a few seconds long, as it has to be to resolve them.
+
+    The magnitudes are calibrated by the window as the fft's are, so they read the same.
+*/
+class ConstantQ
+{
+public:
+    struct Settings
+    {
+        int binsPerOctave {24};
+        float minFrequency {20.f};
+
+        bool operator== (const Settings& other) const
+        {
+            return binsPerOctave == other.binsPerOctave && minFrequency == other.minFrequency;
+        }
+
+        bool operator!= (const Settings& other) const   { return ! operator== (other); }
+    };
+
+    static constexpr int minBinsPerOctave = 6;
+    static constexpr int maxBinsPerOctave = 96;
+
+    /** Sizes the cascade and works out where every bin is read from. This allocates, so do
+        it before the real-time work starts. With no sample rate there are no bins.
+    */
+    void prepare (const Settings& newSettings, double newSampleRate, int numSources)
+    {
+        settings.binsPerOctave = jlimit (minBinsPerOctave, maxBinsPerOctave, newSettings.binsPerOctave);
+        settings.minFrequency = jmax (10.f, newSettings.minFrequency);
+        sampleRate = newSampleRate;
+        fftOrder = getFftOrder (settings.binsPerOctave);
+        fftSize = 1 << fftOrder;
+
+        const auto nyquist = 0.5 * sampleRate;
+        const auto halfBin = std::pow (2., 0.5 / settings.binsPerOctave);
+        const auto numBins = nyquist > settings.minFrequency * halfBin
+                               ? static_cast<int> (std::floor (settings.binsPerOctave * std::log2 (nyquist / settings.minFrequency) - 0.5)) + 1
+                               : 0;
+
+        entries.resize (static_cast<size_t> (numBins));
+        numStages = 0;
+
+        for (auto bin = 0; bin < numBins; ++bin)
+        {
+            const auto centre = static_cast<double> (getBinFrequency (bin));
+            const auto high = centre * halfBin;
+
+            // The deepest stage whose clean band, below a quarter of its rate, reaches the top of the bin
+            const auto stage = jmax (0, static_cast<int> (std::floor (std::log2 (sampleRate / high))) - 2);
+            const auto binsPerHz = fftSize * std::exp2 (stage) / sampleRate;
+
+            auto& entry = entries[static_cast<size_t> (bin)];
+            entry.stage = stage;
+            entry.bin = static_cast<int> (std::ceil (centre / halfBin * binsPerHz));
+            entry.numBins = jmin (static_cast<int> (std::floor (high * binsPerHz)), fftSize / 2) - entry.bin + 1;
+
+            if (entry.numBins < 1)
+            {
+                const auto centrePos = centre * binsPerHz;
+                entry.bin = static_cast<int> (std::floor (centrePos));
+                entry.numBins = 0;
+                entry.weight = static_cast<float> (centrePos - entry.bin);
+            }
+
+            numStages = jmax (numStages, stage + 1);
+        }
+
+        sources.clear ();
+
+        for (auto source = 0; source < numSources; ++source)
+        {
+            auto* state = sources.add (new SourceState ());
+            state->stages.resize (static_cast<size_t> (numStages));
+
+            for (auto& s : state->stages)
+            {
+                s.history.resize (static_cast<size_t> (2 * fftSize));
+                s.magnitudes.resize (static_cast<size_t> (fftSize / 2 + 1));
+            }
+        }
+
+        reset ();
+    }
+
+    /** Clears the cascade, e.g. after a gap in the input. */
+    void reset () noexcept
+    {
+        for (auto* state : sources)
+        {
+            for (auto& s : state->stages)
+            {
+                s.decimator.reset ();
+                std::fill (s.history.begin (), s.history.end (), 0.f);
+                std::fill (s.magnitudes.begin (), s.magnitudes.end (), 0.f);
+                s.writePosition = 0;
+                s.numNewSamples = 0;
+            }
+        }
+    }
+
+    const Settings& getSettings () const noexcept   { return settings; }
+    int getNumBins () const noexcept                { return static_cast<int> (entries.size ()); }
+    int getNumStages () const noexcept              { return numStages; }
+
+    /** The order of the fft every stage uses, which has to be built by whoever calls analyse (). */
+    int getFftOrder () const noexcept               { return fftOrder; }
+
+    float getBinFrequency (int bin) const noexcept
+    {
+        return settings.minFrequency * std::exp2 (static_cast<float> (bin) / static_cast<float> (settings.binsPerOctave));
+    }
+
+    /** The fft size that gives each bin at least one fft bin at the bottom of its stage's
+        clean band, where they're narrowest. Never less than 256, so that even coarse
+        settings leave the window a few fft bins to spread over.
+    */
+    static int getFftOrder (int binsPerOctave)
+    {
+        const auto q = 1. / (std::exp2 (1. / jmax (1, binsPerOctave)) - 1.);
+        return jmax (8, static_cast<int> (std::ceil (std::log2 (8. * q))));
+    }
+
+    /** Feeds more of a source's samples into its cascade. */
+    void push (int source, const float* samples, int numSamples) noexcept
+    {
+        auto& stages = sources.getUnchecked (source)->stages;
+        const auto lastStage = numStages - 1;
+
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            auto value = samples[i];
+
+            // Every other sample a stage takes in, its decimator hands one on to the next
+            for (auto s = 0; s <= lastStage; ++s)
+            {
+                auto& stage = stages[static_cast<size_t> (s)];
+                stage.add (value, fftSize);
+
+                if (s == lastStage || ! stage.decimator.process (value))
+                    break;
+            }
+        }
+    }
+
+    /** Redoes the fft of every stage that has moved on far enough, then reads the bins into
+        magnitudes, which needs room for getNumBins () values. The engine and window are for
+        getFftOrder (), and fftBuffer needs room for twice the fft size. The hop is how
+        many samples were pushed since the last call, so that the first stage, and any other
+        that moves a whole hop between frames, is redone for every frame.
+    */
+    void analyse (int source, FftEngine& engine, const float* window, float* fftBuffer, int hop, float* magnitudes) noexcept
+    {
+        auto& stages = sources.getUnchecked (source)->stages;
+        const auto refreshInterval = jmin (fftSize / 8, hop);
+
+        for (auto& stage : stages)
+        {
+            if (stage.numNewSamples < refreshInterval)
+                continue;
+
+            FloatVectorOperations::multiply (fftBuffer, stage.history.data () + stage.writePosition, window, fftSize);
+            engine.performFrequencyOnlyForwardTransform (fftBuffer);
+            std::copy (fftBuffer, fftBuffer + fftSize / 2 + 1, stage.magnitudes.begin ());
+            stage.numNewSamples = 0;
+        }
+
+        for (size_t bin = 0; bin < entries.size (); ++bin)
+        {
+            const auto& entry = entries[bin];
+            const auto* values = stages[static_cast<size_t> (entry.stage)].magnitudes.data () + entry.bin;
+
+            if (entry.numBins > 0)
+                magnitudes[bin] = FloatVectorOperations::findMaximum (values, entry.numBins);
+            else
+                magnitudes[bin] = values[0] + entry.weight * (values[1] - values[0]);
+        }
+    }
+
+private:
+    /** Halves the sample rate with a 23 tap half-band filter. Only the band below an eighth
+        of the input rate is used downstream, so the filter has until three eighths to reach
+        its stopband, which is what lets it be this short.
+    */
+    class HalfbandDecimator
+    {
+    public:
+        HalfbandDecimator () : coefficients (getCoefficients ()) {}
+
+        void reset () noexcept
+        {
+            line.fill (0.f);
+            position = 0;
+            isOddSample = false;
+        }
+
+        /** Takes the next input sample, returning true and replacing it with an output
+            sample on every other call.
+        */
+        bool process (float& sample) noexcept
+        {
+            line[static_cast<size_t> (position)] = line[static_cast<size_t> (position + numTaps)] = sample;
+            position = (position + 1) % numTaps;
+
+            isOddSample = ! isOddSample;
+
+            if (isOddSample)
+                return false;
+
+            // Oldest first, and apart from the centre only the odd taps aren't zero
+            const auto* x = line.data () + position + centre;
+            auto sum = 0.5f * x[0];
+
+            for (auto k = 0; k < numCoefficients; ++k)
+                sum += coefficients[static_cast<size_t> (k)] * (x[-(2 * k + 1)] + x[2 * k + 1]);
+
+            sample = sum;
+            return true;
+        }
+
+    private:
+        static constexpr int numCoefficients = 6;
+        static constexpr int centre = 2 * numCoefficients - 1;
+        static constexpr int numTaps = 2 * centre + 1;
+
+        /** The odd taps out from the centre, a Kaiser windowed sinc scaled for unity gain at DC,
+            which passes the used band within 0.001 dB and stops the aliases by 78 dB.
+        */
+        static const std::array<float, numCoefficients>& getCoefficients ()
+        {
+            static const auto coefficients = []
+            {
+                std::array<float, numTaps> window;
+                dsp::WindowingFunction<float>::fillWindowingTables (window.data (), window.size (), dsp::WindowingFunction<float>::kaiser, false, 8.f);
+
+                std::array<float, numCoefficients> taps;
+                auto sum = 0.f;
+
+                for (auto k = 0; k < numCoefficients; ++k)
+                {
+                    const auto n = static_cast<float> (2 * k + 1);
+                    const auto sign = k % 2 == 0 ? 1.f : -1.f;
+                    taps[static_cast<size_t> (k)] = sign / (MathConstants<float>::pi * n) * window[static_cast<size_t> (centre + 2 * k + 1)];
+                    sum += taps[static_cast<size_t> (k)];
+                }
+
+                for (auto& tap : taps)
+                    tap *= 0.25f / sum;
+
+                return taps;
+            }();
+
+            return coefficients;
+        }
+
+        const std::array<float, numCoefficients> coefficients;
+        std::array<float, 2 * numTaps> line {};
+        int position {0};
+        bool isOddSample {false};
+    };
+
+    struct Stage
+    {
+        /** Every sample is written twice, so the latest window is always contiguous from writePosition. */
+        void add (float sample, int size) noexcept
+        {
+            history[static_cast<size_t> (writePosition)] = history[static_cast<size_t> (writePosition + size)] = sample;
+            writePosition = (writePosition + 1) % size;
+            ++numNewSamples;
+        }
+
+        HalfbandDecimator decimator;    // feeds the next stage
+        std::vector<float> history;
+        int writePosition {0};
+        int numNewSamples {0};          // since the stage's last fft
+        std::vector<float> magnitudes;  // from the stage's last fft
+    };
+
+    struct SourceState
+    {
+        std::vector<Stage> stages;
+    };
+
+    /** Where a bin is read from. */
+    struct Entry
+    {
+        int stage {0};
+        int bin {0};            // the first fft bin inside it
+        int numBins {0};        // how many fft bins it takes the max of, 0 to interpolate from bin to the next
+        float weight {0.f};     // how far it is from bin towards the next, if it's interpolated
+    };
+
+    Settings settings;
+    double sampleRate {0.};
+    int fftOrder {8};
+    int fftSize {256};
+    int numStages {0};
+    std::vector<Entry> entries;
+    OwnedArray<SourceState> sources;
+};
@@ -0,0 +1,166 @@
+/*
+  ==============================================================================
+
+    FastDecibels.h
+    Created: 16 Oct 2026 8:03:54pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** Converts whole spectra of magnitudes to decibels a SIMD register at a time, for the
+    display and for anything that exports spectra in dB. Nothing is allocated and nothing
+    is shared, so it's safe on the analysis thread as well as the message thread.
+
+    log2 (x) is split into an exponent and a mantissa in [sqrt (1/2), sqrt (2)). The exponent
+    comes from a branch-free binary search of compares and selects, so it's exact and works
+    with any dsp::SIMDRegister, which doesn't do integer shifts or conversions. The log of the
+    mantissa is a degree 6 polynomial fitted at Chebyshev nodes, within 4.2e-6 of log2 over
+    the whole interval. That's 2.5e-5 dB, and with float rounding every result is within
+    1e-4 dB of the exact value, down to the floor.
+
+    Magnitudes are clamped to [-192, +186] dB before conversion, so zeros, denormals and
+    infinities all give finite results.
+*/
+struct FastDecibels
+{
+    /** dest[i] = max (floorDb, 20 log10 (src[i] * gain)). src and dest can be the same. */
+    static void gainToDecibels (const float* src, float* dest, int num, float gain, float floorDb) noexcept
+    {
+        convert (src, dest, num, gain, { floorDb, 1.f, floorDb });
+    }
+
+    /** Like gainToDecibels (), then maps floorDb onto 0 and 0 dB onto 1, which is the
+        display's dB / 100 + 1 for the default floor.
+    */
+    static void gainToRelativeDecibels (const float* src, float* dest, int num, float gain, float floorDb = -100.f) noexcept
+    {
+        jassert (floorDb < 0.f);
+        convert (src, dest, num, gain, { floorDb, -1.f / floorDb, 0.f });
+    }
+
+    /** Converts a single value, exactly as the whole spectrum versions do. */
+    static float gainToDecibels (float gain, float floorDb) noexcept
+    {
+        return convertOne (gain, { floorDb, 1.f, floorDb });
+    }
+
+private:
+    using Vec = dsp::SIMDRegister<float>;
+    using Mask = Vec::vMaskType;
+
+    /** The output is (dB - floorDb) * scale + outputAtFloor. */
+    struct Mapping
+    {
+        float floorDb;
+        float scale;
+        float outputAtFloor;
+    };
+
+    static constexpr float sqrt2 = 1.41421356f;
+    static constexpr float dbPerOctave = 6.02059991f;  // 20 log10 (2)
+
+    static void convert (const float* src, float* dest, int num, float gain, Mapping mapping) noexcept
+    {
+        jassert (mapping.floorDb >= -192.f);
+
+        FloatVectorOperations::copyWithMultiply (dest, src, gain, num);
+
+        auto n = 0;
+
+        for (; n < num && ! Vec::isSIMDAligned (dest + n); ++n)
+            dest[n] = convertOne (dest[n], mapping);
+
+        const auto width = static_cast<int> (Vec::SIMDNumElements);
+        const auto numSimd = (num - n) - (num - n) % width;
+        convertSimd (dest + n, numSimd, mapping);
+
+        for (n += numSimd; n < num; ++n)
+            dest[n] = convertOne (dest[n], mapping);
+    }
+
+    static Vec select (Mask mask, Vec ifTrue, Vec ifFalse) noexcept
+    {
+        return (ifTrue & mask) + (ifFalse & ~mask);
+    }
+
+    static Vec expand (Vec, float value) noexcept       { return Vec::expand (value); }
+    static float expand (float, float value) noexcept   { return value; }
+
+    /** Halves the range x could be in: if x >= 2^octaves, divides it by 2^octaves and adds octaves to the exponent. */
+    static void searchStep (Vec& x, Vec& exponent, float octaves, float threshold, float scale) noexcept
+    {
+        const auto above = Vec::greaterThanOrEqual (x, Vec::expand (threshold));
+        x = select (above, x * Vec::expand (scale), x);
+        exponent = exponent + (Vec::expand (octaves) & above);
+    }
+
+    static void searchStep (float& x, float& exponent, float octaves, float threshold, float scale) noexcept
+    {
+        const auto above = x >= threshold;
+        x = above ? x * scale : x;
+        exponent += above ? octaves : 0.f;
+    }
+
+    /** Returns log2 (x) for x in [2^-32, 2^31]. Written once for both
+        SIMD registers and floats, so the ends of a spectrum match the middle exactly.
+    */
+    template <typename Type>
+    static Type log2 (Type x) noexcept
+    {
+        // Scale up to [1, 2^63], then halve the range the exponent could be in each step
+        x = x * expand (x, 4294967296.f);
+        auto exponent = expand (x, -32.f);
+
+        searchStep (x, exponent, 32.f, 4294967296.f, 1.f / 4294967296.f);
+        searchStep (x, exponent, 16.f, 65536.f, 1.f / 65536.f);
+        searchStep (x, exponent, 8.f, 256.f, 1.f / 256.f);
+        searchStep (x, exponent, 4.f, 16.f, 1.f / 16.f);
+        searchStep (x, exponent, 2.f, 4.f, 0.25f);
+        searchStep (x, exponent, 1.f, 2.f, 0.5f);
+
+        // Centre the mantissa on 1, where the polynomial is most accurate
+        searchStep (x, exponent, 1.f, sqrt2, 0.5f);
+
+        // log2 (1 + f) / f over [sqrt (1/2) - 1, sqrt (2) - 1]
+        const auto f = x - expand (x, 1.f);
+        auto polynomial = expand (x, -0.202289264f);
+        polynomial = polynomial * f + expand (x, 0.316898187f);
+        polynomial = polynomial * f + expand (x, -0.366925771f);
+        polynomial = polynomial * f + expand (x, 0.479925573f);
+        polynomial = polynomial * f + expand (x, -0.721195752f);
+        polynomial = polynomial * f + expand (x, 1.44270044f);
+
+        return exponent + f * polynomial;
+    }
+
+    static void convertSimd (float* data, int numToProcess, Mapping mapping) noexcept
+    {
+        const auto width = static_cast<int> (Vec::SIMDNumElements);
+
+        const auto vMinGain = Vec::expand (2.3283064e-10f);   // 2^-32
+        const auto vMaxGain = Vec::expand (2.1474836e9f);     // 2^31
+        const auto vDbPerOctave = Vec::expand (dbPerOctave);
+        const auto vFloorDb = Vec::expand (mapping.floorDb);
+        const auto vScale = Vec::expand (mapping.scale);
+        const auto vOutputAtFloor = Vec::expand (mapping.outputAtFloor);
+
+        for (auto n = 0; n < numToProcess; n += width)
+        {
+            const auto gain = Vec::min (Vec::max (Vec::fromRawArray (data + n), vMinGain), vMaxGain);
+            const auto dB = Vec::max (log2 (gain) * vDbPerOctave, vFloorDb);
+
+            ((dB - vFloorDb) * vScale + vOutputAtFloor).copyToRawArray (data + n);
+        }
+    }
+
+    static float convertOne (float gain, Mapping mapping) noexcept
+    {
+        const auto dB = jmax (log2 (jlimit (2.3283064e-10f, 2.1474836e9f, gain)) * dbPerOctave, mapping.floorDb);
+        return (dB - mapping.floorDb) * mapping.scale + mapping.outputAtFloor;
+    }
+};
@@ -0,0 +1,268 @@
+/*
+  ==============================================================================
+
+    FftEngine.h
+    Created: 16 Oct 2026 9:41:12am
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** The interface the Visualizer uses to turn a window of real samples into magnitudes. */
+class FftEngine
+{
+public:
+    enum class Type
+    {
+        juce,       // dsp::FFT, which runs a full complex transform
+        realFft     // the built in real input Stockham transform below
+    };
+
+    static constexpr int numTypes = 2;
+
+    virtual ~FftEngine () = default;
+
+    virtual int getSize () const noexcept = 0;
+
+    /** Takes getSize () real samples at the start of a buffer of 2 * getSize () floats, and
+        replaces them with the magnitudes of bins 0 to getSize () / 2 inclusive. Like
+        dsp::FFT, the transform isn't normalised.
+    */
+    virtual void performFrequencyOnlyForwardTransform (float* data) noexcept = 0;
+
+    static String getTypeName (Type type)
+    {
+        switch (type)
+        {
+            case Type::juce:    return "JUCE dsp::FFT";
+            case Type::realFft: return "Real Stockham";
+        }
+
+        return {};
+    }
+
+    static std::unique_ptr<FftEngine> create (Type type, int order);
+};
+
+//==============================================================================
+class JuceFftEngine : public FftEngine
+{
+public:
+    explicit JuceFftEngine (int order) : fft (order) {}
+
+    int getSize () const noexcept override
+    {
+        return fft.getSize ();
+    }
+
+    void performFrequencyOnlyForwardTransform (float* data) noexcept override
+    {
+        fft.performFrequencyOnlyForwardTransform (data);
+    }
+
+private:
+    dsp::FFT fft;
+};
+
+//==============================================================================
+/** A real input fft that packs the even and odd samples into a complex transform of half
+    the size, runs that as a radix-2 Stockham transform on split real and imaginary arrays,
+    and unpacks the result straight into magnitudes.
+
+    The Stockham ordering means every butterfly stage reads and writes contiguous runs of
+    samples, so once a stage's stride reaches the SIMD width the butterflies are done a whole
+    register at a time with dsp::SIMDRegister (SSE, AVX or NEON, whichever JUCE was built with).
+*/
+class RealFftEngine : public FftEngine
+{
+public:
+    explicit RealFftEngine (int order) :
+        size (1 << order),
+        halfSize (size / 2)
+    {
+        jassert (order >= 3);
+
+        // Four split arrays of halfSize each, plus room to align the first one
+        storage.resize (static_cast<size_t> (4 * halfSize) + Vec::SIMDNumElements, 0.f);
+
+        const auto aligned = Vec::getNextSIMDAlignedPtr (storage.data ());
+        real[0] = aligned;
+        imag[0] = aligned + halfSize;
+        real[1] = aligned + 2 * halfSize;
+        imag[1] = aligned + 3 * halfSize;
+
+        // Twiddles of the half size complex transform, exp (-2 pi i k / halfSize)
+        stageCos.resize (static_cast<size_t> (halfSize / 2));
+        stageSin.resize (static_cast<size_t> (halfSize / 2));
+
+        for (auto k = 0; k < halfSize / 2; ++k)
+        {
+            const auto angle = -2. * MathConstants<double>::pi * k / halfSize;
+            stageCos[static_cast<size_t> (k)] = static_cast<float> (std::cos (angle));
+            stageSin[static_cast<size_t> (k)] = static_cast<float> (std::sin (angle));
+        }
+
+        // Twiddles used to unpack the real spectrum, exp (-2 pi i k / size)
+        unpackCos.resize (static_cast<size_t> (halfSize));
+        unpackSin.resize (static_cast<size_t> (halfSize));
+
+        for (auto k = 0; k < halfSize; ++k)
+        {
+            const auto angle = -2. * MathConstants<double>::pi * k / size;
+            unpackCos[static_cast<size_t> (k)] = static_cast<float> (std::cos (angle));
+            unpackSin[static_cast<size_t> (k)] = static_cast<float> (std::sin (angle));
+        }
+    }
+
+    int getSize () const noexcept override
+    {
+        return size;
+    }
+
+    void performFrequencyOnlyForwardTransform (float* data) noexcept override
+    {
+        // Treat the even samples as the real part and the odd samples as the imaginary part
+        auto xr = real[0];
+        auto xi = imag[0];
+
+        for (auto k = 0; k < halfSize; ++k)
+        {
+            xr[k] = data[2 * k];
+            xi[k] = data[2 * k + 1];
+        }
+
+        auto yr = real[1];
+        auto yi = imag[1];
+
+        for (auto n = halfSize, stride = 1; n > 1; n /= 2, stride *= 2)
+        {
+            if (stride >= static_cast<int> (Vec::SIMDNumElements))
+                performStageSimd (n, stride, xr, xi, yr, yi);
+            else
+                performStageScalar (n, stride, xr, xi, yr, yi);
+
+            std::swap (xr, yr);
+            std::swap (xi, yi);
+        }
+
+        unpackMagnitudes (xr, xi, data);
+    }
+
+private:
+    using Vec = dsp::SIMDRegister<float>;
+
+    void performStageScalar (int n, int stride, const float* xr, const float* xi, float* yr, float* yi) const noexcept
+    {
+        const auto m = n / 2;
+
+        for (auto p = 0; p < m; ++p)
+        {
+            const auto wr = stageCos[static_cast<size_t> (p * stride)];
+            const auto wi = stageSin[static_cast<size_t> (p * stride)];
+
+            for (auto q = 0; q < stride; ++q)
+            {
+                const auto a = q + stride * p;
+                const auto b = a + stride * m;
+                const auto out = q + stride * 2 * p;
+
+                const auto dr = xr[a] - xr[b];
+                const auto di = xi[a] - xi[b];
+
+                yr[out] = xr[a] + xr[b];
+                yi[out] = xi[a] + xi[b];
+                yr[out + stride] = dr * wr - di * wi;
+                yi[out + stride] = dr * wi + di * wr;
+            }
+        }
+    }
+
+    void performStageSimd (int n, int stride, const float* xr, const float* xi, float* yr, float* yi) const noexcept
+    {
+        const auto m = n / 2;
+        const auto width = static_cast<int> (Vec::SIMDNumElements);
+
+        for (auto p = 0; p < m; ++p)
+        {
+            const auto wr = Vec::expand (stageCos[static_cast<size_t> (p * stride)]);
+            const auto wi = Vec::expand (stageSin[static_cast<size_t> (p * stride)]);
+
+            for (auto q = 0; q < stride; q += width)
+            {
+                const auto a = q + stride * p;
+                const auto b = a + stride * m;
+                const auto out = q + stride * 2 * p;
+
+                const auto ar = Vec::fromRawArray (xr + a);
+                const auto ai = Vec::fromRawArray (xi + a);
+                const auto br = Vec::fromRawArray (xr + b);
+                const auto bi = Vec::fromRawArray (xi + b);
+
+                const auto dr = ar - br;
+                const auto di = ai - bi;
+
+                (ar + br).copyToRawArray (yr + out);
+                (ai + bi).copyToRawArray (yi + out);
+                (dr * wr - di * wi).copyToRawArray (yr + out + stride);
+                (dr * wi + di * wr).copyToRawArray (yi + out + stride);
+            }
+        }
+    }
+
+    /** Splits the packed spectrum Z into the spectra of the even and odd samples, E and O,
+        and combines them as X[k] = E[k] + exp (-2 pi i k / size) O[k], writing |X[k]| out.
+    */
+    void unpackMagnitudes (const float* zr, const float* zi, float* magnitudes) const noexcept
+    {
+        // Bins 0 and size / 2 only have real parts
+        magnitudes[0] = std::abs (zr[0] + zi[0]);
+        const auto nyquist = std::abs (zr[0] - zi[0]);
+
+        for (auto k = 1; k < halfSize; ++k)
+        {
+            const auto mirror = halfSize - k;
+
+            const auto er = 0.5f * (zr[k] + zr[mirror]);
+            const auto ei = 0.5f * (zi[k] - zi[mirror]);
+            const auto or_ = 0.5f * (zi[k] + zi[mirror]);
+            const auto oi = 0.5f * (zr[mirror] - zr[k]);
+
+            const auto wr = unpackCos[static_cast<size_t> (k)];
+            const auto wi = unpackSin[static_cast<size_t> (k)];
+
+            const auto xr = er + or_ * wr - oi * wi;
+            const auto xi = ei + or_ * wi + oi * wr;
+
+            magnitudes[k] = std::sqrt (xr * xr + xi * xi);
+        }
+
+        magnitudes[halfSize] = nyquist;
+    }
+
+    const int size;
+    const int halfSize;
+
+    std::vector<float> storage;
+    std::array<float*, 2> real {};
+    std::array<float*, 2> imag {};
+
+    std::vector<float> stageCos, stageSin;
+    std::vector<float> unpackCos, unpackSin;
+};
+
+//==============================================================================
+inline std::unique_ptr<FftEngine> FftEngine::create (Type type, int order)
+{
+    switch (type)
+    {
+        case Type::juce:    return std::unique_ptr<FftEngine> (new JuceFftEngine (order));
+        case Type::realFft: return std::unique_ptr<FftEngine> (new RealFftEngine (order));
+    }
+
+    jassertfalse;
+    return {};
+}
@@ -15,6 +15,12 @@ MainComponent::MainComponent()
     // you add any child components.
     setSize (800, 600);
 
+    visualizer.setOverlap (0.75f);
+
+    // Keeps the fft thread ahead of the message thread when the UI is busy. Where realtime
+    // scheduling isn't permitted the thread just stays as it is.
+    visualizer.setThreadSettings ({ Visualizer::ThreadSettings::Policy::roundRobin, 8, 0 });
+
     // Some platforms require permissions to open input channels so request that here
     if (RuntimePermissions::isRequired (RuntimePermissions::recordAudio)
         && ! RuntimePermissions::isGranted (RuntimePermissions::recordAudio))
@@ -29,6 +35,9 @@ MainComponent::MainComponent()
     }
 
     addAndMakeVisible (visualizerComponent);
+
+    // P shows and hides the performance overlay, Q switches between the fft and constant-Q analysis
+    setWantsKeyboardFocus (true);
 }
 
 MainComponent::~MainComponent()
@@ -40,23 +49,16 @@ MainComponent::~MainComponent()
 //==============================================================================
 void MainComponent::prepareToPlay (int samplesPerBlockExpected, double sampleRate)
 {
-    visualizer.setSampleRate (sampleRate);
-    summingBuffer.setSize(1, samplesPerBlockExpected);
+    visualizer.prepareToPlay (sampleRate, samplesPerBlockExpected);
 }
 
 void MainComponent::getNextAudioBlock(const AudioSourceChannelInfo& bufferToFill)
 {
-    const auto numChannels = bufferToFill.buffer->getNumChannels();
-    const auto startSample = bufferToFill.startSample;
-    const auto numSamples = bufferToFill.buffer->getNumSamples();
-
-    summingBuffer.clear();
-    for (auto i = 0; i < numChannels; ++i)
-        summingBuffer.addFrom(0, startSample, *bufferToFill.buffer, i, startSample, numSamples);
-    const auto gain = 1.f / static_cast<float> (numChannels);
-    FloatVectorOperations::multiply(summingBuffer.getWritePointer(0, startSample), gain, numSamples);
+    // The channels are copied, and mixed down, into the analyser's ring on this thread. Its
+    // planes were sized in prepareToPlay (), so whatever the block size, nothing here allocates
+    const AllocationGuard::ScopedNoAllocation noAllocation;
 
-    visualizer.addSamples(summingBuffer.getReadPointer(0), numSamples);
+    visualizer.addSamples (*bufferToFill.buffer, bufferToFill.startSample, bufferToFill.numSamples);
 
     bufferToFill.buffer->clear();
 }
@@ -75,3 +77,21 @@ void MainComponent::resized()
 {
     visualizerComponent.setBounds (getLocalBounds ());
 }
+
+bool MainComponent::keyPressed (const KeyPress& key)
+{
+    if (key.getTextCharacter () == 'p')
+    {
+        visualizerComponent.setPerformanceOverlayVisible (! visualizerComponent.isPerformanceOverlayVisible ());
+        return true;
+    }
+
+    if (key.getTextCharacter () == 'q')
+    {
+        const auto isConstantQ = visualizer.getTransform () == Visualizer::Transform::constantQ;
+        visualizer.setTransform (isConstantQ ? Visualizer::Transform::fft : Visualizer::Transform::constantQ);
+        return true;
+    }
+
+    return false;
+}
@@ -32,12 +32,11 @@ public:
     //==============================================================================
     void paint (Graphics& g) override;
     void resized() override;
+    bool keyPressed (const KeyPress& key) override;
 
 private:
     Visualizer visualizer {12};
     VisualizerComponent visualizerComponent {visualizer};
 
-    AudioBuffer<float> summingBuffer;
-
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MainComponent)
 };
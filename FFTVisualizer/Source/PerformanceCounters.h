@@ -0,0 +1,352 @@
+/*
+  ==============================================================================
+
+    PerformanceCounters.h
+    Created: 16 Oct 2026 11:58:40pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** Set this to 0 to compile the instrumentation out. The classes keep their interface,
+    so the code using them doesn't change, but they record nothing and read no clocks.
+*/
+#ifndef FFTVISUALIZER_PERFORMANCE_COUNTERS
+ #define FFTVISUALIZER_PERFORMANCE_COUNTERS 1
+#endif
+
+/** Lock-free counters for watching the analysis and the display while they run.
+
+    Each counter is written by one thread and can be read from any other, so the audio,
+    fft and message threads can all record into them without locks or allocation.
+    Resetting from a reader while the writer is recording can lose the frames recorded
+    during the reset, which doesn't matter for statistics like these.
+*/
+struct PerformanceCounters
+{
+    static constexpr bool enabled = FFTVISUALIZER_PERFORMANCE_COUNTERS != 0;
+
+    /** Reads the high resolution clock, or returns 0 when the counters are compiled out. */
+    static int64 getTicks () noexcept
+    {
+       #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+        return Time::getHighResolutionTicks ();
+       #else
+        return 0;
+       #endif
+    }
+
+    static double ticksToMs (double ticks) noexcept
+    {
+        return 1000. * ticks / static_cast<double> (Time::getHighResolutionTicksPerSecond ());
+    }
+
+    //==============================================================================
+    class Counter
+    {
+    public:
+        void add (int64 amount = 1) noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            count.fetch_add (amount, std::memory_order_relaxed);
+           #else
+            ignoreUnused (amount);
+           #endif
+        }
+
+        int64 get () const noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            return count.load (std::memory_order_relaxed);
+           #else
+            return 0;
+           #endif
+        }
+
+        void reset () noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            count.store (0, std::memory_order_relaxed);
+           #endif
+        }
+
+    private:
+       #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+        std::atomic<int64> count {0};
+       #endif
+    };
+
+    /** The highest value recorded since the last reset, e.g. the fill level of a buffer. */
+    class Peak
+    {
+    public:
+        void record (int value) noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            if (value > peak.load (std::memory_order_relaxed))
+                peak.store (value, std::memory_order_relaxed);
+           #else
+            ignoreUnused (value);
+           #endif
+        }
+
+        int get () const noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            return peak.load (std::memory_order_relaxed);
+           #else
+            return 0;
+           #endif
+        }
+
+        void reset () noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            peak.store (0, std::memory_order_relaxed);
+           #endif
+        }
+
+    private:
+       #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+        std::atomic<int> peak {0};
+       #endif
+    };
+
+    //==============================================================================
+    struct TimingSnapshot
+    {
+        int64 count {0};
+        double lastMs {0.};
+        double meanMs {0.};
+        double p50Ms {0.};
+        double p99Ms {0.};
+        double maxMs {0.};
+
+        String toString () const
+        {
+            if (count == 0)
+                return "-";
+
+            return "p50 " + String (p50Ms, 3) + "  p99 " + String (p99Ms, 3) + "  max " + String (maxMs, 3) + " ms";
+        }
+    };
+
+    /** A histogram of durations. The buckets are a quarter of an octave wide, so the
+        percentiles are within about 10% of the true value, and recording costs a few
+        relaxed atomic adds however many durations have been recorded.
+    */
+    class Timing
+    {
+    public:
+        void record (int64 ticks) noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            const auto ns = jmax (int64 (0), static_cast<int64> (static_cast<double> (ticks) * getNsPerTick ()));
+
+            buckets[static_cast<size_t> (getBucket (ns))].fetch_add (1, std::memory_order_relaxed);
+            count.fetch_add (1, std::memory_order_relaxed);
+            totalNs.fetch_add (ns, std::memory_order_relaxed);
+            lastNs.store (ns, std::memory_order_relaxed);
+
+            if (ns > maxNs.load (std::memory_order_relaxed))
+                maxNs.store (ns, std::memory_order_relaxed);
+           #else
+            ignoreUnused (ticks);
+           #endif
+        }
+
+        TimingSnapshot getSnapshot () const
+        {
+            TimingSnapshot snapshot;
+
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            std::array<int64, numBuckets> counts;
+            auto total = int64 (0);
+
+            for (size_t i = 0; i < counts.size (); ++i)
+                total += (counts[i] = buckets[i].load (std::memory_order_relaxed));
+
+            if (total == 0)
+                return snapshot;
+
+            const auto getPercentile = [&counts, total] (double proportion)
+            {
+                const auto target = static_cast<int64> (std::ceil (proportion * static_cast<double> (total)));
+                auto sum = int64 (0);
+
+                for (auto i = 0; i < numBuckets; ++i)
+                    if ((sum += counts[static_cast<size_t> (i)]) >= target)
+                        return getBucketCentre (i) * 1.0e-6;
+
+                return getBucketCentre (numBuckets - 1) * 1.0e-6;
+            };
+
+            snapshot.count = total;
+            snapshot.lastMs = static_cast<double> (lastNs.load (std::memory_order_relaxed)) * 1.0e-6;
+            snapshot.meanMs = static_cast<double> (totalNs.load (std::memory_order_relaxed)) * 1.0e-6 / static_cast<double> (jmax (int64 (1), count.load (std::memory_order_relaxed)));
+            snapshot.maxMs = static_cast<double> (maxNs.load (std::memory_order_relaxed)) * 1.0e-6;
+
+            // A bucket's centre can be above the largest value that landed in it
+            snapshot.p50Ms = jmin (getPercentile (0.5), snapshot.maxMs);
+            snapshot.p99Ms = jmin (getPercentile (0.99), snapshot.maxMs);
+           #endif
+
+            return snapshot;
+        }
+
+        void reset () noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            for (auto& bucket : buckets)
+                bucket.store (0, std::memory_order_relaxed);
+
+            count.store (0, std::memory_order_relaxed);
+            totalNs.store (0, std::memory_order_relaxed);
+            lastNs.store (0, std::memory_order_relaxed);
+            maxNs.store (0, std::memory_order_relaxed);
+           #endif
+        }
+
+    private:
+       #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+        static constexpr int numBuckets = 4 * 40;   // up to 2^40 ns, about 18 minutes
+
+        static double getNsPerTick () noexcept
+        {
+            static const auto nsPerTick = 1.0e9 / static_cast<double> (Time::getHighResolutionTicksPerSecond ());
+            return nsPerTick;
+        }
+
+        static int getHighestBit (uint64 value) noexcept
+        {
+            auto bit = 0;
+
+            for (auto shift = 32; shift > 0; shift /= 2)
+            {
+                if ((value >> shift) != 0)
+                {
+                    value >>= shift;
+                    bit += shift;
+                }
+            }
+
+            return bit;
+        }
+
+        /** Below 4 ns each value has its own bucket, above that each octave is split in four. */
+        static int getBucket (int64 ns) noexcept
+        {
+            if (ns < 4)
+                return static_cast<int> (ns);
+
+            const auto highestBit = getHighestBit (static_cast<uint64> (ns));
+            const auto quarter = static_cast<int> ((ns >> (highestBit - 2)) & 3);
+            return jmin (numBuckets - 1, 4 * highestBit + quarter);
+        }
+
+        static double getBucketCentre (int bucket) noexcept
+        {
+            if (bucket < 4)
+                return bucket;
+
+            const auto highestBit = bucket / 4;
+            const auto quarter = bucket % 4;
+            return std::ldexp (4.5 + quarter, highestBit - 2);
+        }
+
+        std::array<std::atomic<int64>, numBuckets> buckets {};
+        std::atomic<int64> count {0};
+        std::atomic<int64> totalNs {0};
+        std::atomic<int64> lastNs {0};
+        std::atomic<int64> maxNs {0};
+       #endif
+    };
+
+    /** Records the time until it goes out of scope. A null timing records nothing, so
+        code that's sometimes measured can always create one.
+    */
+    class ScopedTiming
+    {
+    public:
+        explicit ScopedTiming (Timing* timingToUse) noexcept
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            : timing (timingToUse),
+              start (timing != nullptr ? getTicks () : 0)
+           #endif
+        {
+           #if ! FFTVISUALIZER_PERFORMANCE_COUNTERS
+            ignoreUnused (timingToUse);
+           #endif
+        }
+
+        ~ScopedTiming () noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            if (timing != nullptr)
+                timing->record (getTicks () - start);
+           #endif
+        }
+
+    private:
+       #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+        Timing* const timing;
+        const int64 start;
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedTiming)
+    };
+
+    /** Counts the frames a timer driven view draws, and the ones it misses because its
+        callbacks arrive late, e.g. while the message thread is busy. Call tick () from
+        each callback, and restart () whenever the timer stops or changes rate.
+    */
+    class FrameClock
+    {
+    public:
+        void tick (int framesPerSecond) noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            const auto now = getTicks ();
+
+            if (lastTicks != 0)
+            {
+                const auto period = static_cast<double> (Time::getHighResolutionTicksPerSecond ()) / jmax (1, framesPerSecond);
+                const auto numMissed = roundToInt (static_cast<double> (now - lastTicks) / period) - 1;
+
+                if (numMissed > 0)
+                    numDropped.add (numMissed);
+            }
+
+            numFrames.add ();
+            lastTicks = now;
+           #else
+            ignoreUnused (framesPerSecond);
+           #endif
+        }
+
+        void restart () noexcept
+        {
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            lastTicks = 0;
+           #endif
+        }
+
+        void reset () noexcept
+        {
+            numFrames.reset ();
+            numDropped.reset ();
+        }
+
+        Counter numFrames;
+        Counter numDropped;
+
+    private:
+       #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+        int64 lastTicks {0};
+       #endif
+    };
+};
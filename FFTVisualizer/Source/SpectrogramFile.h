@@ -0,0 +1,514 @@
+/*
+  ==============================================================================
+
+    SpectrogramFile.h
+    Created: 16 Oct 2026 5:48:10pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "FastDecibels.h"
+
+/** A spectrogram on disk: a fixed size header followed by fixed size frame records, so
+    frame n is always at headerSize + n * frameSize and any part of a multi-hour file can be
+    read through a memory mapping without touching the rest.
+
+    Each record starts with the int64 sample position of its window, followed by numBins
+    values for each source. The positions only ever go up, so they double as the time index:
+    the reader binary searches them rather than assuming the hop never changed (frames are
+    skipped when a live analyser overruns).
+
+    Magnitudes are stored multiplied by gainScale. The analyser already calibrates them so
+    that a full scale sine reads 0 dB whatever the fft size and window (see WindowFunction),
+    so the writer stores them as they are, with a gainScale of 1. Everything is in the
+    machine's byte order, which is little endian on every platform the projects build for.
+*/
+struct SpectrogramFile
+{
+    enum class Encoding
+    {
+        float32,    // exact
+        float16,    // IEEE half precision, within 0.05% of the float value
+        decibels8   // one byte per bin on a linear dB scale, within 0.24 dB between the floor and ceiling
+    };
+
+    /** What's being written, which the analyser knows once it's seen the input. */
+    struct Layout
+    {
+        double sampleRate {0.};
+        int fftSize {0};
+        int hopSize {0};
+        Array<int> sources;     // the SpectrumAnalyser::Source in each slot of a frame
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32 version;
+        uint32 headerSize;
+        uint32 frameSize;           // bytes per frame record, including its sample position
+        uint32 encoding;
+        uint32 numSources;
+        uint32 numBins;
+        uint32 fftSize;
+        uint32 hopSize;
+        double sampleRate;
+        int64 numFrames;            // filled in when the writer finishes, see SpectrogramReader
+        float gainScale;
+        float dbFloor;
+        float dbCeiling;
+        uint32 reserved;
+        uint8 sources[32];
+    };
+
+    static_assert (sizeof (Header) == 104, "The header layout is part of the file format");
+
+    static constexpr uint32 currentVersion = 1;
+    static constexpr int maxNumSources = 32;
+    static constexpr int maxNumBins = 1 << 15;     // half of SpectrumAnalyser's largest fft
+
+    static const char* getMagic () noexcept      { return "FFTSPEC"; }
+
+    static int getBytesPerValue (Encoding encoding) noexcept
+    {
+        switch (encoding)
+        {
+            case Encoding::float32:     return 4;
+            case Encoding::float16:     return 2;
+            case Encoding::decibels8:   return 1;
+        }
+
+        return 4;
+    }
+
+    static int getFrameSize (Encoding encoding, int numSources, int numBins) noexcept
+    {
+        const auto size = static_cast<int> (sizeof (int64)) + numSources * numBins * getBytesPerValue (encoding);
+        return (size + 7) & ~7;     // keep every record's position 8 byte aligned
+    }
+
+    /** Rounds to the nearest half, with ties to even, saturating to infinity. */
+    static uint16 floatToHalf (float value) noexcept
+    {
+        uint32 bits;
+        std::memcpy (&bits, &value, sizeof (bits));
+
+        const auto sign = static_cast<uint16> ((bits >> 16) & 0x8000u);
+        const auto exponent = static_cast<int> ((bits >> 23) & 0xffu) - 127 + 15;
+        auto mantissa = bits & 0x7fffffu;
+
+        if (exponent >= 31)
+            return static_cast<uint16> (sign | (((bits & 0x7fffffffu) > 0x7f800000u) ? 0x7e00u : 0x7c00u));
+
+        if (exponent <= 0)
+        {
+            if (exponent < -10)
+                return sign;
+
+            mantissa |= 0x800000u;
+            const auto shift = static_cast<uint32> (14 - exponent);
+            const auto halfway = 1u << (shift - 1);
+            auto half = mantissa >> shift;
+            const auto remainder = mantissa & ((1u << shift) - 1u);
+
+            if (remainder > halfway || (remainder == halfway && (half & 1u) != 0))
+                ++half;
+
+            return static_cast<uint16> (sign | half);
+        }
+
+        auto half = static_cast<uint32> (exponent << 10) | (mantissa >> 13);
+        const auto remainder = mantissa & 0x1fffu;
+
+        // A carry out of the mantissa correctly bumps the exponent, up to infinity at worst
+        if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u) != 0))
+            ++half;
+
+        return static_cast<uint16> (sign | half);
+    }
+
+    static float halfToFloat (uint16 half) noexcept
+    {
+        const auto sign = static_cast<uint32> (half & 0x8000u) << 16;
+        auto exponent = static_cast<int> ((half >> 10) & 0x1fu);
+        auto mantissa = static_cast<uint32> (half & 0x3ffu);
+        uint32 bits;
+
+        if (exponent == 31)
+        {
+            bits = sign | 0x7f800000u | (mantissa << 13);
+        }
+        else if (exponent == 0)
+        {
+            if (mantissa == 0)
+            {
+                bits = sign;
+            }
+            else
+            {
+                // Normalise the subnormal
+                exponent = 1;
+
+                while ((mantissa & 0x400u) == 0)
+                {
+                    mantissa <<= 1;
+                    --exponent;
+                }
+
+                bits = sign | static_cast<uint32> (exponent - 15 + 127) << 23 | ((mantissa & 0x3ffu) << 13);
+            }
+        }
+        else
+        {
+            bits = sign | static_cast<uint32> (exponent - 15 + 127) << 23 | (mantissa << 13);
+        }
+
+        float value;
+        std::memcpy (&value, &bits, sizeof (value));
+        return value;
+    }
+};
+
+//==============================================================================
+/** Streams frames into a spectrogram file as they're analysed. */
+class SpectrogramWriter
+{
+public:
+    using Encoding = SpectrogramFile::Encoding;
+
+    SpectrogramWriter (const File& fileToWrite, const SpectrogramFile::Layout& layout, Encoding encodingToUse,
+                       float dbFloorToUse = -120.f, float dbCeilingToUse = 0.f) :
+        encoding (encodingToUse),
+        numSources (layout.sources.size ()),
+        numBins (layout.fftSize / 2),
+        gainScale (1.f),
+        dbFloor (dbFloorToUse),
+        dbCeiling (dbCeilingToUse)
+    {
+        jassert (numSources > 0 && numSources <= SpectrogramFile::maxNumSources);
+        jassert (numBins > 0 && numBins <= SpectrogramFile::maxNumBins);
+
+        fileToWrite.deleteFile ();
+        stream.reset (new FileOutputStream (fileToWrite, 1 << 20));
+
+        header = {};
+        std::strcpy (header.magic, SpectrogramFile::getMagic ());
+        header.version = SpectrogramFile::currentVersion;
+        header.headerSize = sizeof (SpectrogramFile::Header);
+        header.frameSize = static_cast<uint32> (SpectrogramFile::getFrameSize (encoding, numSources, numBins));
+        header.encoding = static_cast<uint32> (encoding);
+        header.numSources = static_cast<uint32> (numSources);
+        header.numBins = static_cast<uint32> (numBins);
+        header.fftSize = static_cast<uint32> (layout.fftSize);
+        header.hopSize = static_cast<uint32> (layout.hopSize);
+        header.sampleRate = layout.sampleRate;
+        header.gainScale = gainScale;
+        header.dbFloor = dbFloor;
+        header.dbCeiling = dbCeiling;
+
+        for (auto i = 0; i < numSources; ++i)
+            header.sources[i] = static_cast<uint8> (layout.sources[i]);
+
+        record.resize (header.frameSize, 0);
+        pendingMagnitudes.resize (static_cast<size_t> (numSources * numBins), 0.f);
+
+        if (encoding == Encoding::decibels8)
+            decibels.resize (pendingMagnitudes.size ());
+
+        if (stream->openedOk ())
+            stream->write (&header, sizeof (header));
+    }
+
+    ~SpectrogramWriter ()
+    {
+        finish ();
+    }
+
+    bool openedOk () const
+    {
+        return stream != nullptr && stream->openedOk ();
+    }
+
+    /** Appends a frame. magnitudes holds numBins values for each slot of the layout, one
+        slot after another, and a slot that wasn't analysed should be left as zeros.
+    */
+    void writeFrame (int64 samplePosition, const float* magnitudes)
+    {
+        if (! openedOk ())
+            return;
+
+        std::memcpy (record.data (), &samplePosition, sizeof (samplePosition));
+        auto* values = record.data () + sizeof (samplePosition);
+        const auto numValues = numSources * numBins;
+
+        switch (encoding)
+        {
+            case Encoding::float32:
+            {
+                for (auto i = 0; i < numValues; ++i)
+                {
+                    const auto value = magnitudes[i] * gainScale;
+                    std::memcpy (values + 4 * i, &value, 4);
+                }
+
+                break;
+            }
+
+            case Encoding::float16:
+            {
+                for (auto i = 0; i < numValues; ++i)
+                {
+                    const auto value = SpectrogramFile::floatToHalf (magnitudes[i] * gainScale);
+                    std::memcpy (values + 2 * i, &value, 2);
+                }
+
+                break;
+            }
+
+            case Encoding::decibels8:
+            {
+                const auto stepsPerDb = 255.f / (dbCeiling - dbFloor);
+                FastDecibels::gainToDecibels (magnitudes, decibels.data (), numValues, gainScale, dbFloor);
+
+                for (auto i = 0; i < numValues; ++i)
+                    values[i] = static_cast<uint8> (jlimit (0, 255, roundToInt ((decibels[static_cast<size_t> (i)] - dbFloor) * stepsPerDb)));
+
+                break;
+            }
+        }
+
+        stream->write (record.data (), record.size ());
+        ++header.numFrames;
+    }
+
+    /** Adds one slot of a frame, for analysers that produce a frame's sources one after
+        another. The frame is written when a slot of a later frame arrives, or on finish (),
+        and any slot it wasn't given is written as zeros.
+    */
+    void writeSource (int64 samplePosition, int slot, const float* magnitudes)
+    {
+        jassert (slot >= 0 && slot < numSources);
+
+        if (samplePosition != pendingPosition)
+            writePendingFrame ();
+
+        pendingPosition = samplePosition;
+        FloatVectorOperations::copy (pendingMagnitudes.data () + slot * numBins, magnitudes, numBins);
+    }
+
+    int getNumBins () const
+    {
+        return numBins;
+    }
+
+    int64 getNumFrames () const
+    {
+        return header.numFrames;
+    }
+
+    /** Writes the frame count into the header and closes the file. */
+    void finish ()
+    {
+        if (! openedOk ())
+            return;
+
+        writePendingFrame ();
+        stream->flush ();
+        stream->setPosition (static_cast<int64> (offsetof (SpectrogramFile::Header, numFrames)));
+        stream->write (&header.numFrames, sizeof (header.numFrames));
+        stream.reset ();
+    }
+
+private:
+    void writePendingFrame ()
+    {
+        if (pendingPosition < 0)
+            return;
+
+        writeFrame (pendingPosition, pendingMagnitudes.data ());
+        std::fill (pendingMagnitudes.begin (), pendingMagnitudes.end (), 0.f);
+        pendingPosition = -1;
+    }
+
+    const Encoding encoding;
+    const int numSources;
+    const int numBins;
+    const float gainScale;
+    const float dbFloor;
+    const float dbCeiling;
+
+    SpectrogramFile::Header header;
+    std::unique_ptr<FileOutputStream> stream;
+    std::vector<uint8> record;
+    std::vector<float> pendingMagnitudes;
+    std::vector<float> decibels;
+    int64 pendingPosition {-1};
+
+    JUCE_DECLARE_NON_COPYABLE (SpectrogramWriter)
+};
+
+//==============================================================================
+/** Reads a spectrogram file through a memory mapping. Only the frames that are asked for
+    are ever paged in, so opening and searching a multi-hour file is instant.
+*/
+class SpectrogramReader
+{
+public:
+    using Encoding = SpectrogramFile::Encoding;
+
+    explicit SpectrogramReader (const File& fileToRead) :
+        mappedFile (fileToRead, MemoryMappedFile::readOnly)
+    {
+        const auto size = mappedFile.getSize ();
+
+        if (mappedFile.getData () == nullptr || size < sizeof (SpectrogramFile::Header))
+            return;
+
+        std::memcpy (&header, mappedFile.getData (), sizeof (header));
+
+        // Nothing in the header is trusted until it's all been checked, as every later
+        // read is an offset into the mapping worked out from it
+        if (std::strncmp (header.magic, SpectrogramFile::getMagic (), sizeof (header.magic)) != 0
+             || header.version != SpectrogramFile::currentVersion
+             || header.headerSize < sizeof (SpectrogramFile::Header)
+             || header.headerSize > size
+             || header.encoding > static_cast<uint32> (Encoding::decibels8)
+             || header.numSources < 1
+             || header.numSources > static_cast<uint32> (SpectrogramFile::maxNumSources)
+             || header.numBins < 1
+             || header.numBins > static_cast<uint32> (SpectrogramFile::maxNumBins)
+             || header.frameSize != static_cast<uint32> (SpectrogramFile::getFrameSize (static_cast<Encoding> (header.encoding),
+                                                                                          static_cast<int> (header.numSources),
+                                                                                          static_cast<int> (header.numBins)))
+             || ! (header.gainScale > 0.f && std::isfinite (header.gainScale))
+             || ! (header.dbCeiling > header.dbFloor))
+        {
+            header = {};
+            return;
+        }
+
+        // If the writer never finished, or the file was cut short, trust the whole frames
+        // that made it to disk and ignore any partial record at the end
+        const auto framesOnDisk = static_cast<int64> ((size - header.headerSize) / header.frameSize);
+        numFrames = header.numFrames > 0 ? jmin (header.numFrames, framesOnDisk) : framesOnDisk;
+
+        data = static_cast<const uint8*> (mappedFile.getData ()) + header.headerSize;
+    }
+
+    bool isValid () const noexcept                  { return data != nullptr; }
+
+    int64 getNumFrames () const noexcept            { return numFrames; }
+    int getNumBins () const noexcept                { return static_cast<int> (header.numBins); }
+    int getNumSources () const noexcept             { return static_cast<int> (header.numSources); }
+    int getSource (int slot) const noexcept         { return header.sources[slot]; }
+    int getFftSize () const noexcept                { return static_cast<int> (header.fftSize); }
+    int getHopSize () const noexcept                { return static_cast<int> (header.hopSize); }
+    double getSampleRate () const noexcept          { return header.sampleRate; }
+    Encoding getEncoding () const noexcept          { return static_cast<Encoding> (header.encoding); }
+
+    int64 getSamplePosition (int64 frame) const noexcept
+    {
+        int64 position;
+        std::memcpy (&position, getRecord (frame), sizeof (position));
+        return position;
+    }
+
+    /** Returns the last frame whose window starts at or before samplePosition, or 0. */
+    int64 findFrame (int64 samplePosition) const noexcept
+    {
+        int64 low = 0;
+        auto high = numFrames;
+
+        while (high - low > 1)
+        {
+            const auto middle = low + (high - low) / 2;
+
+            if (getSamplePosition (middle) <= samplePosition)
+                low = middle;
+            else
+                high = middle;
+        }
+
+        return low;
+    }
+
+    /** Returns the frames whose windows start in [startSeconds, endSeconds). */
+    Range<int64> getFrameRange (double startSeconds, double endSeconds) const noexcept
+    {
+        const auto toFrame = [this] (double seconds)
+        {
+            const auto position = static_cast<int64> (std::ceil (seconds * header.sampleRate));
+            const auto frame = findFrame (position);
+            return numFrames > 0 && getSamplePosition (frame) < position ? frame + 1 : frame;
+        };
+
+        const auto start = toFrame (startSeconds);
+        return { start, jmax (start, toFrame (endSeconds)) };
+    }
+
+    /** Decodes one slot of one frame back into unscaled magnitudes, as SpectrumAnalyser produced them. */
+    void readFrame (int64 frame, int slot, float* magnitudes) const noexcept
+    {
+        jassert (frame >= 0 && frame < numFrames && slot >= 0 && slot < getNumSources ());
+
+        const auto numValues = getNumBins ();
+        const auto bytesPerValue = SpectrogramFile::getBytesPerValue (getEncoding ());
+        const auto* values = getRecord (frame) + sizeof (int64) + static_cast<size_t> (slot * numValues * bytesPerValue);
+        const auto scale = 1.f / header.gainScale;
+
+        switch (getEncoding ())
+        {
+            case Encoding::float32:
+            {
+                for (auto i = 0; i < numValues; ++i)
+                {
+                    float value;
+                    std::memcpy (&value, values + 4 * i, 4);
+                    magnitudes[i] = value * scale;
+                }
+
+                break;
+            }
+
+            case Encoding::float16:
+            {
+                for (auto i = 0; i < numValues; ++i)
+                {
+                    uint16 value;
+                    std::memcpy (&value, values + 2 * i, 2);
+                    magnitudes[i] = SpectrogramFile::halfToFloat (value) * scale;
+                }
+
+                break;
+            }
+
+            case Encoding::decibels8:
+            {
+                const auto dbPerStep = (header.dbCeiling - header.dbFloor) / 255.f;
+
+                for (auto i = 0; i < numValues; ++i)
+                    magnitudes[i] = values[i] == 0 ? 0.f
+                                                   : Decibels::decibelsToGain (header.dbFloor + dbPerStep * values[i]) * scale;
+
+                break;
+            }
+        }
+    }
+
+private:
+    const uint8* getRecord (int64 frame) const noexcept
+    {
+        return data + frame * static_cast<int64> (header.frameSize);
+    }
+
+    MemoryMappedFile mappedFile;
+    SpectrogramFile::Header header {};
+    const uint8* data {nullptr};
+    int64 numFrames {0};
+
+    JUCE_DECLARE_NON_COPYABLE (SpectrogramReader)
+};
@@ -0,0 +1,961 @@
+/*
+  ==============================================================================
+
+    SpectrumAnalyser.h
+    Created: 16 Oct 2026 2:14:05pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "Utilities.h"
+#include "FftEngine.h"
+#include "Ballistics.h"
+#include "WindowFunction.h"
+#include "ConstantQ.h"
+
+/** The analysis behind the Visualizer, with no thread or display attached. Samples are
+    written in on one thread, and perform () windows, transforms and smooths every frame
+    that's ready on another (or the same) thread, handing each one to a callback.
+    Magnitudes are calibrated by the window, see WindowFunction, so 1 is 0 dB.
+
+    The Visualizer runs this on its fft thread to feed the display, and the offline
+    analyser runs it as fast as it can over decoded files.
+*/
+class SpectrumAnalyser
+{
+public:
+    /** What the writer does when perform () falls so far behind that a new block won't
+        fit in the input ring.
+    */
+    enum class OverflowPolicy
+    {
+        dropOldest,     // overwrite the oldest samples, perform () carries on from the oldest ones left
+        dropNewest,     // keep what's in the ring and throw away the part of the block that doesn't fit
+        skipToLatest    // overwrite the oldest samples, perform () jumps to the most recent window
+    };
+
+    struct InputStats
+    {
+        int64 numSamplesReceived {0};
+        int64 numSamplesDropped {0};    // samples that never made it into a window
+        int64 numOverruns {0};          // how many times the analysis fell behind
+        int bufferSize {0};
+        int numSamplesBuffered {0};     // samples written but not yet reached by perform ()
+    };
+
+    /** The kinds of spectrum perform () can produce. */
+    enum class Transform
+    {
+        fft,        // fftSize / 2 bins evenly spaced from DC
+        constantQ   // bins evenly spaced in log frequency, see ConstantQ
+    };
+
+    /** The spectra the analyser can produce. Channel n of the input is firstChannelSource + n. */
+    enum Source
+    {
+        sumSource = 0,      // the mean of all input channels
+        midSource,          // (left + right) / 2
+        sideSource,         // (left - right) / 2
+        firstChannelSource
+    };
+
+    /** One analysed frame of one source, as handed to the perform () callback. The pointers
+        are only valid for the duration of the callback.
+    */
+    struct Frame
+    {
+        int source {sumSource};
+        Transform transform {Transform::fft};
+        int numBins {0};
+        int64 samplePosition {0};       // position of the first input sample in the analysed window (for constant-Q, the shortest one)
+        const float* rawMagnitudes {nullptr};   // straight out of the fft, before the ballistics
+        const float* magnitudes {nullptr};
+        const float* max {nullptr};
+        bool maxChanged {false};
+    };
+
+    static constexpr int minFftOrder = 8;
+    static constexpr int maxFftOrder = 16;
+
+    explicit SpectrumAnalyser (int fftOrder, int maxNumChannelsToUse = 2) :
+        maxNumChannels (maxNumChannelsToUse)
+    {
+        jassert (fftOrder >= minFftOrder && fftOrder <= maxFftOrder);
+        jassert (maxNumChannels > 0 && getNumSources () <= 32);
+
+        // Every supported size is built up front so that switching never allocates in perform ()
+        for (auto order = minFftOrder; order <= maxFftOrder; ++order)
+            setups[static_cast<size_t> (order - minFftOrder)].reset (new AnalysisSetup (order, getNumSources ()));
+
+        windows.initialiseAll ([] (WindowFunction::Tables& tables) { tables.build ({}, minFftOrder, maxFftOrder); });
+
+        currentOrder = fftOrder;
+        requestedOrder = fftOrder;
+        currentSetup = getSetup (fftOrder);
+
+        // Until prepare () is called, be generous about the block size
+        ring.prepare (maxNumChannels, 48000., 4096);
+    }
+
+    /** Sizes the input ring for the given sample rate and largest block size. Nothing else
+        may be using the analyser while this is called.
+    */
+    void prepare (double fs, int maximumBlockSize)
+    {
+        ring.prepare (maxNumChannels, fs, maximumBlockSize);
+        nextFrameStart = 0;
+
+        for (auto& setup : setups)
+            for (auto* b : setup->ballistics)
+                b->reset ();
+
+        setSampleRate (fs);
+    }
+
+    /** Changes the sample rate the analysis is calibrated for, rebuilding the constant-Q
+        analysis for it. Not from the audio thread, as that allocates.
+    */
+    void setSampleRate (double fs)
+    {
+        const ScopedLock sl (constantQLock);
+        sampleRate = fs;
+
+        if (isConstantQBuilt)
+            buildConstantQ ();
+    }
+
+    double getSampleRate () const {     return sampleRate;    }
+
+    /** Asks perform () to switch to a new fft size from its next call. */
+    void setFftOrder (int newOrder)
+    {
+        requestedOrder = jlimit (minFftOrder, maxFftOrder, newOrder);
+    }
+
+    int getFftOrder () const
+    {
+        return currentOrder;
+    }
+
+    int getFftSize () const
+    {
+        return 1 << currentOrder;
+    }
+
+    /** The number of bins in the frames perform () is producing, for whichever transform it's using. */
+    int getNumBins () const
+    {
+        return currentTransform == Transform::constantQ ? numConstantQBins.load () : getFftSize () / 2;
+    }
+
+    static int getMaxNumBins ()
+    {
+        return (1 << maxFftOrder) / 2;
+    }
+
+    /** Asks perform () to switch between the fft and the constant-Q analysis from its next
+        call. Either starts again from fresh, with its max cleared. The constant-Q analysis
+        is built the first time it's asked for, so don't call this from the audio thread.
+        Its hop follows the fft size and overlap as the fft's does.
+    */
+    void setTransform (Transform newTransform)
+    {
+        if (newTransform == Transform::constantQ)
+        {
+            const ScopedLock sl (constantQLock);
+
+            if (! isConstantQBuilt)
+                buildConstantQ ();
+        }
+
+        requestedTransform = newTransform;
+    }
+
+    Transform getTransform () const
+    {
+        return currentTransform;
+    }
+
+    /** Chooses the resolution and range of the constant-Q analysis. It's built here, so
+        don't call this from the audio thread. perform () picks it up from its next call,
+        starting the analysis again.
+    */
+    void setConstantQ (const ConstantQ::Settings& newSettings)
+    {
+        const ScopedLock sl (constantQLock);
+        constantQSettings = newSettings;
+        buildConstantQ ();
+    }
+
+    /** Returns the settings last passed to setConstantQ (). */
+    ConstantQ::Settings getConstantQ () const
+    {
+        const ScopedLock sl (constantQLock);
+        return constantQSettings;
+    }
+
+    /** Chooses which fft implementation perform () uses from the next frame on. */
+    void setFftEngine (FftEngine::Type newType)
+    {
+        engineType = newType;
+    }
+
+    FftEngine::Type getFftEngine () const
+    {
+        return engineType;
+    }
+
+    /** Changes the attack, release and peak hold. Call this from the same thread each
+        time, perform () picks the settings up on its next frame.
+    */
+    void setBallistics (const Ballistics::Settings& newSettings)
+    {
+        ballisticsSettings.getWriteBuffer () = newSettings;
+        ballisticsSettings.publish ();
+    }
+
+    /** Chooses the window and calibration perform () uses from its next call. The tables
+        for every fft size are built here, so call this from the same thread each time and
+        not from the audio thread. Going back to a recent window reuses its tables.
+    */
+    void setWindow (const WindowFunction::Settings& newSettings)
+    {
+        windows.getWriteBuffer ().build (newSettings, minFftOrder, maxFftOrder);
+        windows.publish ();
+        windowSettings = newSettings;
+    }
+
+    /** Returns the settings last passed to setWindow (), from the thread that calls it. */
+    const WindowFunction::Settings& getWindow () const
+    {
+        return windowSettings;
+    }
+
+    /** Returns the coherent gain and ENBW of the window at the given fft size. */
+    WindowFunction::Properties getWindowProperties (int order) const
+    {
+        std::vector<float> samples (static_cast<size_t> (1 << order));
+        return WindowFunction::fill (samples.data (), 1 << order, windowSettings);
+    }
+
+    /** Sets how many samples the analysis window advances by between frames. The hop is
+        stored relative to the fft size, so it scales when the fft order changes.
+    */
+    void setHopSize (int newHopSize)
+    {
+        const auto fftSize = getFftSize ();
+        setOverlap (1.f - static_cast<float> (jlimit (1, fftSize, newHopSize)) / static_cast<float> (fftSize));
+    }
+
+    int getHopSize () const
+    {
+        return jmax (1, roundToInt (static_cast<float> (getFftSize ()) * (1.f - overlap.load ())));
+    }
+
+    /** Sets the fraction of each window shared with the previous one, e.g. 0.75 for 75% overlap. */
+    void setOverlap (float newOverlap)
+    {
+        overlap = jlimit (0.f, 1.f, newOverlap);
+    }
+
+    int getMaxNumChannels () const
+    {
+        return maxNumChannels;
+    }
+
+    int getNumSources () const
+    {
+        return firstChannelSource + maxNumChannels;
+    }
+
+    static String getSourceName (int source)
+    {
+        switch (source)
+        {
+            case sumSource:     return "Sum";
+            case midSource:     return "Mid";
+            case sideSource:    return "Side";
+            default:            return "Channel " + String (source - firstChannelSource + 1);
+        }
+    }
+
+    /** Only enabled sources are analysed, so the cost per frame grows with the number
+        of spectra actually being looked at. The sum is enabled by default.
+    */
+    void setSourceEnabled (int source, bool shouldBeEnabled)
+    {
+        jassert (source >= 0 && source < getNumSources ());
+        const auto bit = 1u << static_cast<uint32> (source);
+
+        if (shouldBeEnabled)
+            enabledSources |= bit;
+        else
+            enabledSources &= ~bit;
+    }
+
+    bool isSourceEnabled (int source) const
+    {
+        return (enabledSources.load () & (1u << static_cast<uint32> (source))) != 0;
+    }
+
+    void setOverflowPolicy (OverflowPolicy newPolicy)
+    {
+        ring.policy = newPolicy;
+    }
+
+    OverflowPolicy getOverflowPolicy () const
+    {
+        return ring.policy;
+    }
+
+    /** Returns the input ring's counters. Safe to call from any thread. */
+    InputStats getInputStats () const
+    {
+        return ring.getStats ();
+    }
+
+    //==============================================================================
+    // The writers below must all be called from the same producer thread.
+
+    void addSamples (const float* samples, int numSamples)
+    {
+        addSamples (&samples, 1, numSamples);
+    }
+
+    /** Adds planar samples, one pointer per channel. Channels beyond getMaxNumChannels () are ignored. */
+    void addSamples (const float* const* channelData, int numChannels, int numSamples)
+    {
+        const auto numToAdd = jmin (numChannels, maxNumChannels);
+
+        ring.write (numToAdd, numSamples, [channelData] (int channel, float* dest, int sourceStart, int num)
+        {
+            FloatVectorOperations::copy (dest, channelData[channel] + sourceStart, num);
+        });
+
+        numInputChannels = numToAdd;
+    }
+
+    void addSamples (const AudioBuffer<float>& buffer, int startSample, int numSamples)
+    {
+        const auto numToAdd = jmin (buffer.getNumChannels (), maxNumChannels);
+
+        ring.write (numToAdd, numSamples, [&buffer, startSample] (int channel, float* dest, int sourceStart, int num)
+        {
+            FloatVectorOperations::copy (dest, buffer.getReadPointer (channel, startSample + sourceStart), num);
+        });
+
+        numInputChannels = numToAdd;
+    }
+
+    /** Adds interleaved samples, numChannels to each sample frame. */
+    void addInterleavedSamples (const float* samples, int numChannels, int numSamples)
+    {
+        const auto numToAdd = jmin (numChannels, maxNumChannels);
+
+        ring.write (numToAdd, numSamples, [samples, numChannels] (int channel, float* dest, int sourceStart, int num)
+        {
+            const auto* source = samples + sourceStart * numChannels + channel;
+
+            for (auto i = 0; i < num; ++i)
+                dest[i] = source[i * numChannels];
+        });
+
+        numInputChannels = numToAdd;
+    }
+
+    //==============================================================================
+    // Everything below must be called from the same consumer thread.
+
+    /** Analyses every frame that's ready, calling frameCallback (const Frame&) for each
+        enabled source of each frame. Returns the number of frames analysed.
+    */
+    template <typename FrameCallback>
+    int perform (FrameCallback&& frameCallback)
+    {
+        const auto order = requestedOrder.load ();
+        if (order != currentOrder)
+            switchToOrder (order);
+
+        windows.acquire ();
+
+        // A new constant-Q setup comes fresh from buildConstantQ (), so there's nothing to reset
+        const auto transform = requestedTransform.load ();
+        constantQ.acquire ();
+
+        if (transform != currentTransform)
+            switchToTransform (transform);
+
+        if (currentTransform == Transform::constantQ)
+            return performConstantQ (frameCallback);
+
+        const auto fftSize = currentSetup->fftSize;
+        auto numFrames = 0;
+
+        // The writer never waits for us, so we may have fallen so far behind
+        // that the next window has been overwritten.
+        if (! ring.isStillValid (nextFrameStart))
+            recoverFromOverrun (fftSize);
+
+        while (ring.getNumWritten () - nextFrameStart >= fftSize)
+        {
+            const auto hop = getHopSize ();
+            const auto numChannels = numInputChannels.load ();
+            const auto sources = enabledSources.load ();
+
+            // The time constants are specified in real time, so they have to follow the time between frames.
+            ballisticsSettings.acquire ();
+            const auto& settings = ballisticsSettings.getReadBuffer ();
+
+            for (auto source = 0; source < getNumSources (); ++source)
+            {
+                if ((sources & (1u << static_cast<uint32> (source))) == 0
+                     || ! mixSourceIntoProcessingBuffer (source, numChannels, nextFrameStart))
+                    continue;
+
+                // Don't hand out a window the writer overwrote while we were reading it
+                if (! ring.isStillValid (nextFrameStart))
+                    break;
+
+                currentSetup->getEngine (engineType).performFrequencyOnlyForwardTransform (currentSetup->processingBuffer.getWritePointer (0));
+                frameCallback (applyBallistics (*currentSetup->ballistics.getUnchecked (source), currentSetup->processingBuffer.getReadPointer (0),
+                                                source, settings, hop, nextFrameStart));
+            }
+
+            if (ring.isStillValid (nextFrameStart))
+            {
+                nextFrameStart += hop;
+                ++numFrames;
+            }
+            else
+            {
+                recoverFromOverrun (fftSize);
+            }
+
+            ring.setReadPosition (nextFrameStart);
+        }
+
+        return numFrames;
+    }
+
+    /** Clears the max of every source. */
+    void clearMax ()
+    {
+        for (auto* b : getCurrentBallistics ())
+            b->clearMax ();
+    }
+
+    const Ballistics& getBallistics (int source) const
+    {
+        return *getCurrentBallistics ().getUnchecked (source);
+    }
+
+    /** The position of the first sample of the next window perform () will analyse. */
+    int64 getNextFrameStart () const
+    {
+        return nextFrameStart;
+    }
+
+private:
+    /** Everything that depends on the fft size. */
+    struct AnalysisSetup
+    {
+        AnalysisSetup (int fftOrder, int numSources) :
+            order (fftOrder),
+            fftSize (1 << fftOrder)
+        {
+            for (auto type = 0; type < FftEngine::numTypes; ++type)
+                engines[static_cast<size_t> (type)] = FftEngine::create (static_cast<FftEngine::Type> (type), order);
+
+            // The magnitudes are processed a SIMD register at a time, so keep them aligned
+            using Vec = dsp::SIMDRegister<float>;
+            processingStorage.resize (static_cast<size_t> (2 * fftSize) + Vec::SIMDNumElements, 0.f);
+            float* channels[] = { Vec::getNextSIMDAlignedPtr (processingStorage.data ()) };
+            processingBuffer.setDataToReferTo (channels, 1, 2 * fftSize);
+
+            scratchBuffer.setSize (1, fftSize, false, true);
+
+            for (auto source = 0; source < numSources; ++source)
+                ballistics.add (new Ballistics ())->prepare (fftSize / 2);
+        }
+
+        FftEngine& getEngine (FftEngine::Type type) const
+        {
+            return *engines[static_cast<size_t> (type)];
+        }
+
+        const int order;
+        const int fftSize;
+        std::array<std::unique_ptr<FftEngine>, FftEngine::numTypes> engines;
+
+        std::vector<float> processingStorage;
+        AudioBuffer<float> processingBuffer;
+
+        AudioBuffer<float> scratchBuffer;
+
+        OwnedArray<Ballistics> ballistics;
+    };
+
+    /** The constant-Q analysis and what goes with it, built together off the consumer thread. */
+    struct ConstantQSetup
+    {
+        void prepare (const ConstantQ::Settings& settings, double fs, int numSources)
+        {
+            analysis.prepare (settings, fs, numSources);
+            const auto numBins = analysis.getNumBins ();
+
+            using Vec = dsp::SIMDRegister<float>;
+            magnitudeStorage.assign (static_cast<size_t> (numBins) + Vec::SIMDNumElements, 0.f);
+            magnitudes = Vec::getNextSIMDAlignedPtr (magnitudeStorage.data ());
+
+            // The hop is read out of the ring a block at a time, however long it is
+            input.assign (1024, 0.f);
+            scratch.assign (input.size (), 0.f);
+
+            ballistics.clear ();
+
+            for (auto source = 0; source < numSources; ++source)
+                ballistics.add (new Ballistics ())->prepare (numBins);
+        }
+
+        ConstantQ analysis;
+
+        std::vector<float> magnitudeStorage;
+        float* magnitudes {nullptr};
+
+        std::vector<float> input;
+        std::vector<float> scratch;
+
+        OwnedArray<Ballistics> ballistics;
+    };
+
+    AnalysisSetup* getSetup (int order) const
+    {
+        return setups[static_cast<size_t> (order - minFftOrder)].get ();
+    }
+
+    const OwnedArray<Ballistics>& getCurrentBallistics () const
+    {
+        return currentTransform == Transform::constantQ ? constantQ.getReadBuffer ().ballistics : currentSetup->ballistics;
+    }
+
+    /** Builds a new constant-Q setup and hands it to perform (). Both the message thread
+        and prepare () on the audio device thread can get here, so it's called with
+        constantQLock held to keep the setup's triple buffer to one producer at a time.
+    */
+    void buildConstantQ ()
+    {
+        auto& setup = constantQ.getWriteBuffer ();
+        setup.prepare (constantQSettings, sampleRate, getNumSources ());
+        jassert (setup.analysis.getNumBins () <= getMaxNumBins ());
+
+        constantQ.publish ();
+        numConstantQBins = setup.analysis.getNumBins ();
+        isConstantQBuilt = true;
+    }
+
+    void switchToTransform (Transform transform)
+    {
+        currentTransform = transform;
+
+        for (auto* b : getCurrentBallistics ())
+            b->reset ();
+
+        if (transform == Transform::constantQ)
+            constantQ.getReadBuffer ().analysis.reset ();
+
+        // Like a change of fft size, start from samples we already have
+        nextFrameStart = jmax (int64 (0), ring.getNumWritten () - getFftSize ());
+        ring.setReadPosition (nextFrameStart);
+    }
+
+    /** perform () for the constant-Q analysis, which takes each hop of samples into its
+        cascade as it arrives, rather than windowing them out of the ring.
+    */
+    template <typename FrameCallback>
+    int performConstantQ (FrameCallback&& frameCallback)
+    {
+        auto& setup = constantQ.getReadBuffer ();
+        auto& analysis = setup.analysis;
+        auto numFrames = 0;
+
+        // Without a sample rate there are no bins, so just keep up with the writer
+        if (analysis.getNumBins () == 0)
+        {
+            nextFrameStart = ring.getNumWritten ();
+            ring.setReadPosition (nextFrameStart);
+            return 0;
+        }
+
+        const auto order = analysis.getFftOrder ();
+        auto& engine = getSetup (order)->getEngine (engineType);
+        const auto* window = windows.getReadBuffer ().getTable (order);
+        auto* fftBuffer = getSetup (order)->processingBuffer.getWritePointer (0);
+        const auto blockSize = static_cast<int> (setup.input.size ());
+
+        if (! ring.isStillValid (nextFrameStart))
+            recoverFromOverrun (getHopSize ());
+
+        while (ring.getNumWritten () - nextFrameStart >= getHopSize ())
+        {
+            const auto hop = getHopSize ();
+            const auto numChannels = numInputChannels.load ();
+            const auto sources = enabledSources.load ();
+
+            ballisticsSettings.acquire ();
+            const auto& settings = ballisticsSettings.getReadBuffer ();
+
+            for (auto source = 0; source < getNumSources (); ++source)
+            {
+                if ((sources & (1u << static_cast<uint32> (source))) == 0)
+                    continue;
+
+                auto canMakeSource = true;
+
+                for (auto done = 0; done < hop && canMakeSource; done += blockSize)
+                {
+                    const auto num = jmin (blockSize, hop - done);
+                    canMakeSource = readSource (source, numChannels, nextFrameStart + done, nullptr, setup.input.data (), setup.scratch.data (), num);
+
+                    if (canMakeSource)
+                        analysis.push (source, setup.input.data (), num);
+                }
+
+                if (! canMakeSource)
+                    continue;
+
+                if (! ring.isStillValid (nextFrameStart))
+                    break;
+
+                analysis.analyse (source, engine, window, fftBuffer, hop, setup.magnitudes);
+
+                const auto windowStart = jmax (int64 (0), nextFrameStart + hop - (1 << order));
+                frameCallback (applyBallistics (*setup.ballistics.getUnchecked (source), setup.magnitudes, source, settings, hop, windowStart));
+            }
+
+            // The cascade can't bridge a gap, so it starts again after one
+            if (ring.isStillValid (nextFrameStart))
+            {
+                nextFrameStart += hop;
+                ++numFrames;
+            }
+            else
+            {
+                recoverFromOverrun (hop);
+                analysis.reset ();
+            }
+
+            ring.setReadPosition (nextFrameStart);
+        }
+
+        return numFrames;
+    }
+
+    void switchToOrder (int order)
+    {
+        currentSetup = getSetup (order);
+
+        // The constant-Q analysis only takes its hop from the fft size, so it carries on from where it was
+        if (currentTransform == Transform::constantQ)
+        {
+            currentOrder = order;
+            return;
+        }
+
+        for (auto* b : currentSetup->ballistics)
+            b->reset ();
+
+        // Start the first window of the new size from samples we already have, so the
+        // display doesn't go blank while we wait for a whole new window to arrive.
+        const auto fftSize = currentSetup->fftSize;
+        nextFrameStart = jmax (int64 (0), ring.getNumWritten () - fftSize);
+        ring.setReadPosition (nextFrameStart);
+
+        currentOrder = order;
+    }
+
+    /** Moves on from a window the writer has overwritten, as the overflow policy says. */
+    void recoverFromOverrun (int fftSize)
+    {
+        const auto previousStart = nextFrameStart;
+
+        if (ring.policy.load () == OverflowPolicy::skipToLatest)
+            nextFrameStart = ring.getNumWritten () - fftSize;
+        else
+            nextFrameStart = ring.getOldestValidPosition ();
+
+        ring.overrunOccurred (jmax (int64 (0), nextFrameStart - previousStart));
+    }
+
+    /** Windows the samples for a source straight out of the ring into the processing buffer,
+        returning false if the source can't be made from the channels we have.
+    */
+    bool mixSourceIntoProcessingBuffer (int source, int numChannels, int64 frameStart)
+    {
+        return readSource (source, numChannels, frameStart, windows.getReadBuffer ().getTable (currentSetup->order),
+                           currentSetup->processingBuffer.getWritePointer (0), currentSetup->scratchBuffer.getWritePointer (0),
+                           currentSetup->fftSize);
+    }
+
+    /** Reads numSamples of a source out of the ring into destination, multiplied by the
+        window unless it's null, returning false if the source can't be made from the
+        channels we have. Mid and side need numSamples of scratch.
+    */
+    bool readSource (int source, int numChannels, int64 start, const float* window, float* destination, float* scratch, int numSamples) const noexcept
+    {
+        const auto read = [this, start, window, numSamples] (int plane, float* dest)
+        {
+            if (window != nullptr)
+                ring.readWindowed (plane, start, window, dest, numSamples);
+            else
+                ring.read (plane, start, dest, numSamples);
+        };
+
+        switch (source)
+        {
+            case sumSource:
+            {
+                read (ring.getMixPlane (), destination);
+                return true;
+            }
+
+            case midSource:
+            case sideSource:
+            {
+                if (numChannels < 2)
+                    return false;
+
+                // With two channels the mix plane already holds (left + right) / 2
+                if (source == midSource && numChannels == 2)
+                {
+                    read (ring.getMixPlane (), destination);
+                    return true;
+                }
+
+                read (0, destination);
+                read (1, scratch);
+
+                if (source == midSource)
+                    FloatVectorOperations::add (destination, scratch, numSamples);
+                else
+                    FloatVectorOperations::subtract (destination, scratch, numSamples);
+
+                FloatVectorOperations::multiply (destination, 0.5f, numSamples);
+                return true;
+            }
+
+            default:
+            {
+                const auto channel = source - firstChannelSource;
+                if (channel >= numChannels)
+                    return false;
+
+                read (channel, destination);
+                return true;
+            }
+        }
+    }
+
+    Frame applyBallistics (Ballistics& ballistics, const float* rawMagnitudes, int source, const Ballistics::Settings& settings, int hop, int64 frameStart)
+    {
+        ballistics.setTiming (settings, static_cast<double> (hop) / sampleRate);
+
+        const auto numPeaksChanged = ballistics.process (rawMagnitudes);
+
+        Frame frame;
+        frame.source = source;
+        frame.transform = currentTransform;
+        frame.numBins = ballistics.getNumBins ();
+        frame.samplePosition = frameStart;
+        frame.rawMagnitudes = rawMagnitudes;
+        frame.magnitudes = ballistics.getOutput ();
+        frame.max = ballistics.getMax ();
+        frame.maxChanged = numPeaksChanged > 0 || ballistics.peaksDecay ();
+        return frame;
+    }
+
+    /** The one ring the writer writes into and perform () windows straight out of.
+        There's a plane per channel, plus one more that holds the mean of the channels,
+        which is mixed while each block is being written.
+
+        The ring holds the largest fft window, room for perform () to lag behind by
+        maxLagSeconds, and a reserve for the block the writer is part way through
+        writing. Blocks are published a reserve at a time, so a window perform ()
+        thinks is valid can never be under a write in progress.
+    */
+    struct InputRing
+    {
+        static constexpr double maxLagSeconds = 0.5;
+
+        void prepare (int numChannels, double sampleRate, int maximumBlockSize)
+        {
+            reserve = jmax (1024, 2 * maximumBlockSize);
+            const auto size = (1 << maxFftOrder) + reserve + roundToInt (sampleRate * maxLagSeconds);
+
+            planes.setSize (numChannels + 1, size, false, true);
+            numWritten = 0;
+            readPosition = 0;
+        }
+
+        int getSize () const noexcept       { return planes.getNumSamples (); }
+        int getMixPlane () const noexcept   { return planes.getNumChannels () - 1; }
+
+        int64 getNumWritten () const noexcept
+        {
+            return numWritten.load (std::memory_order_acquire);
+        }
+
+        /** The oldest sample that's safe to read, allowing for a write in progress. */
+        int64 getOldestValidPosition () const noexcept
+        {
+            return jmax (int64 (0), getNumWritten () + reserve - getSize ());
+        }
+
+        /** True if the samples from startPosition on can't have been overwritten yet. */
+        bool isStillValid (int64 startPosition) const noexcept
+        {
+            return startPosition >= getOldestValidPosition ();
+        }
+
+        /** Called by the reader with the first sample it still needs, which is as far
+            as a dropNewest write is allowed to fill the ring up to.
+        */
+        void setReadPosition (int64 position) noexcept
+        {
+            readPosition.store (position, std::memory_order_release);
+        }
+
+        void overrunOccurred (int64 numSamplesSkipped) noexcept
+        {
+            numDropped += numSamplesSkipped;
+            ++numOverruns;
+        }
+
+        InputStats getStats () const noexcept
+        {
+            InputStats stats;
+            stats.numSamplesReceived = numReceived.load ();
+            stats.numSamplesDropped = numDropped.load ();
+            stats.numOverruns = numOverruns.load ();
+            stats.bufferSize = getSize ();
+            stats.numSamplesBuffered = static_cast<int> (jmax (int64 (0), getNumWritten () - readPosition.load ()));
+            return stats;
+        }
+
+        /** Calls copyChannel (channel, destination, sourceOffset, numSamples) for each channel
+            and contiguous region of the ring, then mixes those regions into the mix plane.
+            With no channels the samples still count, but the mix is written as silence.
+        */
+        template <typename CopyFunction>
+        void write (int numChannels, int numSamples, CopyFunction&& copyChannel)
+        {
+            const auto start = numWritten.load (std::memory_order_relaxed);
+            auto numToWrite = numSamples;
+
+            numReceived += numSamples;
+
+            if (policy.load () == OverflowPolicy::dropNewest)
+            {
+                const auto space = readPosition.load (std::memory_order_acquire) + getSize () - reserve - start;
+                numToWrite = static_cast<int> (jlimit (int64 (0), int64 (numSamples), space));
+
+                if (numToWrite < numSamples)
+                    overrunOccurred (numSamples - numToWrite);
+            }
+
+            const auto gain = numChannels > 0 ? 1.f / static_cast<float> (numChannels) : 0.f;
+            auto* mix = planes.getWritePointer (getMixPlane ());
+
+            for (auto done = 0; done < numToWrite;)
+            {
+                const auto position = static_cast<int> ((start + done) % getSize ());
+                const auto num = jmin (numToWrite - done, getSize () - position, reserve);
+
+                if (numChannels <= 0)
+                    FloatVectorOperations::clear (mix + position, num);
+
+                for (auto channel = 0; channel < numChannels; ++channel)
+                {
+                    auto* dest = planes.getWritePointer (channel, position);
+                    copyChannel (channel, dest, done, num);
+
+                    if (channel == 0)
+                        FloatVectorOperations::copyWithMultiply (mix + position, dest, gain, num);
+                    else
+                        FloatVectorOperations::addWithMultiply (mix + position, dest, gain, num);
+                }
+
+                done += num;
+                numWritten.store (start + done, std::memory_order_release);
+            }
+        }
+
+        /** Copies numSamples from startPosition into destination. */
+        void read (int plane, int64 startPosition, float* destination, int numSamples) const noexcept
+        {
+            const auto position = static_cast<int> (startPosition % getSize ());
+            const auto num1 = jmin (numSamples, getSize () - position);
+
+            FloatVectorOperations::copy (destination, planes.getReadPointer (plane, position), num1);
+
+            if (num1 < numSamples)
+                FloatVectorOperations::copy (destination + num1, planes.getReadPointer (plane), numSamples - num1);
+        }
+
+        /** Writes numSamples from startPosition, multiplied by the window, into destination. */
+        void readWindowed (int plane, int64 startPosition, const float* window, float* destination, int numSamples) const noexcept
+        {
+            const auto position = static_cast<int> (startPosition % getSize ());
+            const auto num1 = jmin (numSamples, getSize () - position);
+
+            FloatVectorOperations::multiply (destination, planes.getReadPointer (plane, position), window, num1);
+
+            if (num1 < numSamples)
+                FloatVectorOperations::multiply (destination + num1, planes.getReadPointer (plane), window + num1, numSamples - num1);
+        }
+
+        AudioBuffer<float> planes;
+        int reserve {0};
+        std::atomic<int64> numWritten {0};
+        std::atomic<int64> readPosition {0};
+        std::atomic<OverflowPolicy> policy {OverflowPolicy::dropOldest};
+
+        std::atomic<int64> numReceived {0};
+        std::atomic<int64> numDropped {0};
+        std::atomic<int64> numOverruns {0};
+    };
+
+    InputRing ring;
+
+    std::atomic<double> sampleRate {0.};
+
+    const int maxNumChannels;
+    std::atomic<int> numInputChannels {1};
+    std::atomic<uint32> enabledSources {1u << sumSource};
+
+    std::array<std::unique_ptr<AnalysisSetup>, maxFftOrder - minFftOrder + 1> setups;
+    AnalysisSetup* currentSetup {nullptr};
+    std::atomic<int> currentOrder {0};
+    std::atomic<int> requestedOrder {0};
+    std::atomic<FftEngine::Type> engineType {FftEngine::Type::realFft};
+
+    TripleBuffer<ConstantQSetup> constantQ;
+    CriticalSection constantQLock;      // held by whichever thread is producing a constant-Q setup
+    ConstantQ::Settings constantQSettings;
+    bool isConstantQBuilt {false};
+    std::atomic<int> numConstantQBins {0};
+    std::atomic<Transform> currentTransform {Transform::fft};
+    std::atomic<Transform> requestedTransform {Transform::fft};
+
+    TripleBuffer<Ballistics::Settings> ballisticsSettings;
+    TripleBuffer<WindowFunction::Tables> windows;
+    WindowFunction::Settings windowSettings;
+
+    int64 nextFrameStart {0};
+    std::atomic<float> overlap {0.f};
+
+    JUCE_DECLARE_NON_COPYABLE (SpectrumAnalyser)
+};
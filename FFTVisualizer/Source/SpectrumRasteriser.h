@@ -0,0 +1,127 @@
+/*
+  ==============================================================================
+
+    SpectrumRasteriser.h
+    Created: 16 Oct 2026 9:41:18pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** Draws the fft graph's bars straight into an image's pixels, so a frame costs one pass
+    over the image and a single blit, rather than a Graphics call per column.
+
+    Each bar runs from its value up from the bottom of the image and is antialiased at the
+    top the way Graphics::drawVerticalLine () does it, with the top pixel covered by the
+    fraction of it the bar reaches. The image is filled a row at a time: rows above every
+    bar and below every bar top are copied from the first one of their kind, and the rest
+    work out each pixel's coverage in a loop the compiler can vectorise, then look its
+    colour up in a 256 entry palette. Only plain memory is touched, so it works the same
+    with the software renderer on a machine with no GPU.
+*/
+class SpectrumRasteriser
+{
+public:
+    SpectrumRasteriser (Colour background, Colour bars)
+    {
+        setColours (background, bars);
+    }
+
+    /** The bars are drawn over an opaque background, so translucent bars are blended with it here. */
+    void setColours (Colour background, Colour bars)
+    {
+        const auto opaqueBackground = background.withAlpha (1.f);
+        const auto opaqueBars = opaqueBackground.overlaidWith (bars);
+
+        for (auto i = 0; i < paletteSize; ++i)
+            palette[static_cast<size_t> (i)] = opaqueBackground.interpolatedWith (opaqueBars, i / static_cast<float> (paletteSize - 1)).getPixelARGB ();
+    }
+
+    /** Draws a bar per pixel column from values between 0 (the bottom) and 1 (the top),
+        into an RGB or ARGB image. Columns past numValues are left as they are.
+    */
+    void render (const float* values, int numValues, Image::BitmapData& pixels)
+    {
+        jassert (pixels.pixelFormat == Image::RGB || pixels.pixelFormat == Image::ARGB);
+
+        const auto width = jmin (numValues, pixels.width);
+        const auto height = pixels.height;
+        const auto fullHeight = height * subPixels;
+
+        if (tops.size () < static_cast<size_t> (width))
+        {
+            tops.resize (static_cast<size_t> (width));
+            coverage.resize (static_cast<size_t> (width));
+        }
+
+        // Each bar's top, in 1/256ths of a pixel down from the top of the image
+        auto highestTop = fullHeight;
+        auto lowestTop = 0;
+
+        for (auto x = 0; x < width; ++x)
+        {
+            const auto top = jlimit (0, fullHeight, roundToInt ((1.f - values[x]) * static_cast<float> (fullHeight)));
+            tops[static_cast<size_t> (x)] = top;
+            highestTop = jmin (highestTop, top);
+            lowestTop = jmax (lowestTop, top);
+        }
+
+        const uint8* emptyRow = nullptr;
+        const uint8* fullRow = nullptr;
+        const auto rowBytes = static_cast<size_t> (width * pixels.pixelStride);
+
+        for (auto y = 0; y < height; ++y)
+        {
+            auto* line = pixels.getLinePointer (y);
+            const auto rowTop = y * subPixels;
+            const auto rowBottom = rowTop + subPixels;
+
+            if (rowBottom <= highestTop || rowTop >= lowestTop)
+            {
+                // Every pixel in the row is the background, or every pixel is a bar
+                auto& sameRow = rowBottom <= highestTop ? emptyRow : fullRow;
+
+                if (sameRow != nullptr)
+                {
+                    std::memcpy (line, sameRow, rowBytes);
+                    continue;
+                }
+
+                std::fill (coverage.begin (), coverage.begin () + width, static_cast<uint8> (rowBottom <= highestTop ? 0 : paletteSize - 1));
+                sameRow = line;
+            }
+            else
+            {
+                const auto* rowTops = tops.data ();
+                auto* rowCoverage = coverage.data ();
+
+                for (auto x = 0; x < width; ++x)
+                    rowCoverage[x] = static_cast<uint8> (jlimit (0, paletteSize - 1, rowBottom - rowTops[x]));
+            }
+
+            if (pixels.pixelFormat == Image::ARGB)
+                writeRow<PixelARGB> (line, pixels.pixelStride, width);
+            else
+                writeRow<PixelRGB> (line, pixels.pixelStride, width);
+        }
+    }
+
+private:
+    static constexpr int subPixels = 256;
+    static constexpr int paletteSize = 256;
+
+    template <typename PixelType>
+    void writeRow (uint8* line, int pixelStride, int width) const
+    {
+        for (auto x = 0; x < width; ++x)
+            reinterpret_cast<PixelType*> (line + x * pixelStride)->set (palette[coverage[static_cast<size_t> (x)]]);
+    }
+
+    std::array<PixelARGB, paletteSize> palette;
+    std::vector<int> tops;
+    std::vector<uint8> coverage;
+};
@@ -31,6 +31,75 @@ struct LambdaTimer : public juce::Timer
     std::function<void()> callbackFunction;
 };
 
+/** A wait-free single producer, single consumer channel. The producer fills the write
+    buffer and publishes it, and the consumer always picks up the most recently published
+    buffer without ever seeing one that is still being written.
+*/
+template <typename ValueType>
+class TripleBuffer
+{
+public:
+    TripleBuffer () = default;
+
+    /** Calls the function on all three buffers. Only call this while neither side is in use. */
+    template <typename Function>
+    void initialiseAll (Function&& function)
+    {
+        for (auto& buffer : buffers)
+            function (buffer);
+    }
+
+    ValueType& getWriteBuffer () noexcept
+    {
+        return buffers[static_cast<size_t> (writeIndex)];
+    }
+
+    void publish () noexcept
+    {
+        writeIndex = state.exchange (writeIndex | freshBit, std::memory_order_acq_rel) & indexMask;
+        numPublished.fetch_add (1, std::memory_order_release);
+    }
+
+    /** Swaps in the latest published buffer, returning false if nothing new was published. */
+    bool acquire () noexcept
+    {
+        if ((state.load (std::memory_order_acquire) & freshBit) == 0)
+            return false;
+
+        readIndex = state.exchange (readIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    const ValueType& getReadBuffer () const noexcept
+    {
+        return buffers[static_cast<size_t> (readIndex)];
+    }
+
+    /** The consumer owns the read buffer until its next acquire (), so it may also keep
+        state of its own in it. The producer overwrites that when it next writes the buffer.
+    */
+    ValueType& getReadBuffer () noexcept
+    {
+        return buffers[static_cast<size_t> (readIndex)];
+    }
+
+    uint64 getNumPublished () const noexcept
+    {
+        return numPublished.load (std::memory_order_acquire);
+    }
+
+private:
+    enum { indexMask = 3, freshBit = 4 };
+
+    std::array<ValueType, 3> buffers;
+    std::atomic<int> state {0};
+    int writeIndex {1};
+    int readIndex {2};
+    std::atomic<uint64> numPublished {0};
+
+    JUCE_DECLARE_NON_COPYABLE (TripleBuffer)
+};
+
 namespace RangeUtils
 {
     static float normalizedToLogRange (float normVal, float logRangeMin, float logRangeMax)
@@ -9,3 +9,245 @@
 */
 
 #include "Visualizer.h"
+
+#if JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+ #include <pthread.h>
+#elif JUCE_WINDOWS
+ #define NOMINMAX
+ #include <windows.h>
+#else
+ #include <semaphore.h>
+ #include <pthread.h>
+ #include <sched.h>
+ #include <sys/resource.h>
+ #include <cerrno>
+ #include <ctime>
+#endif
+
+//==============================================================================
+// The JUCE WaitableEvent takes a mutex when signalled, which we can't do from the
+// audio thread, so the fft thread's wakeup uses the native counting semaphores.
+#if JUCE_MAC || JUCE_IOS
+
+struct Visualizer::Wakeup::Pimpl
+{
+    Pimpl () : semaphore (dispatch_semaphore_create (0)) {}
+    ~Pimpl () { dispatch_release (semaphore); }
+
+    void signal () noexcept { dispatch_semaphore_signal (semaphore); }
+
+    bool wait (int timeoutMilliseconds) noexcept
+    {
+        const auto timeout = dispatch_time (DISPATCH_TIME_NOW, static_cast<int64_t> (timeoutMilliseconds) * NSEC_PER_MSEC);
+        return dispatch_semaphore_wait (semaphore, timeout) == 0;
+    }
+
+    dispatch_semaphore_t semaphore;
+};
+
+#elif JUCE_WINDOWS
+
+struct Visualizer::Wakeup::Pimpl
+{
+    Pimpl () : semaphore (CreateSemaphoreW (nullptr, 0, LONG_MAX, nullptr)) {}
+    ~Pimpl () { CloseHandle (semaphore); }
+
+    void signal () noexcept { ReleaseSemaphore (semaphore, 1, nullptr); }
+
+    bool wait (int timeoutMilliseconds) noexcept
+    {
+        return WaitForSingleObject (semaphore, static_cast<DWORD> (timeoutMilliseconds)) == WAIT_OBJECT_0;
+    }
+
+    HANDLE semaphore;
+};
+
+#else
+
+struct Visualizer::Wakeup::Pimpl
+{
+    Pimpl () { sem_init (&semaphore, 0, 0); }
+    ~Pimpl () { sem_destroy (&semaphore); }
+
+    void signal () noexcept { sem_post (&semaphore); }
+
+    bool wait (int timeoutMilliseconds) noexcept
+    {
+        timespec deadline;
+        clock_gettime (CLOCK_REALTIME, &deadline);
+
+        deadline.tv_sec += timeoutMilliseconds / 1000;
+        deadline.tv_nsec += (timeoutMilliseconds % 1000) * 1000000L;
+
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        while (sem_timedwait (&semaphore, &deadline) != 0)
+            if (errno != EINTR)
+                return false;
+
+        return true;
+    }
+
+    sem_t semaphore;
+};
+
+#endif
+
+//==============================================================================
+Visualizer::Wakeup::Wakeup () : pimpl (new Pimpl ()) {}
+Visualizer::Wakeup::~Wakeup () = default;
+
+void Visualizer::Wakeup::signal () noexcept
+{
+    pimpl->signal ();
+}
+
+bool Visualizer::Wakeup::wait (int timeoutMilliseconds) noexcept
+{
+    return pimpl->wait (timeoutMilliseconds);
+}
+
+//==============================================================================
+#if JUCE_WINDOWS
+
+Visualizer::AppliedThreadSettings Visualizer::applyToCurrentThread (const ThreadSettings& settings) noexcept
+{
+    using Policy = ThreadSettings::Policy;
+
+    AppliedThreadSettings applied;
+    const auto thread = GetCurrentThread ();
+    const auto priority = jlimit (0, 10, settings.priority);
+
+    // Windows has no realtime policies for a thread, so both get the highest priority in
+    // the process's class, and normal spreads the priority over lowest to highest
+    const auto isRealtime = settings.policy != Policy::normal;
+    const auto nativePriority = isRealtime ? THREAD_PRIORITY_TIME_CRITICAL
+                                           : THREAD_PRIORITY_LOWEST + (THREAD_PRIORITY_HIGHEST - THREAD_PRIORITY_LOWEST) * priority / 10;
+
+    if (SetThreadPriority (thread, nativePriority) != 0)
+    {
+        applied.policy = settings.policy;
+    }
+    else
+    {
+        applied.fellBack = true;
+        applied.errorCode = static_cast<int> (GetLastError ());
+    }
+
+    applied.nativePriority = GetThreadPriority (thread);
+
+    DWORD_PTR processMask = 0, systemMask = 0;
+    GetProcessAffinityMask (GetCurrentProcess (), &processMask, &systemMask);
+
+    const auto requestedMask = settings.affinityMask != 0 ? static_cast<DWORD_PTR> (settings.affinityMask) & processMask : processMask;
+
+    if (requestedMask != 0 && SetThreadAffinityMask (thread, requestedMask) != 0)
+    {
+        applied.affinityMask = requestedMask;
+    }
+    else
+    {
+        applied.fellBack = true;
+        applied.errorCode = requestedMask != 0 ? static_cast<int> (GetLastError ()) : ERROR_INVALID_PARAMETER;
+    }
+
+    return applied;
+}
+
+#else
+
+Visualizer::AppliedThreadSettings Visualizer::applyToCurrentThread (const ThreadSettings& settings) noexcept
+{
+    using Policy = ThreadSettings::Policy;
+
+    AppliedThreadSettings applied;
+    const auto thread = pthread_self ();
+    const auto priority = jlimit (0, 10, settings.priority);
+
+    const auto setPolicy = [thread] (int policy, int nativePriority)
+    {
+        sched_param param {};
+        param.sched_priority = nativePriority;
+        return pthread_setschedparam (thread, policy, &param);
+    };
+
+    auto result = 0;
+
+    if (settings.policy != Policy::normal)
+    {
+        const auto policy = settings.policy == Policy::fifo ? SCHED_FIFO : SCHED_RR;
+        const auto minPriority = sched_get_priority_min (policy);
+        const auto nativePriority = minPriority + (sched_get_priority_max (policy) - minPriority) * priority / 10;
+
+        result = setPolicy (policy, nativePriority);
+
+       #if JUCE_LINUX
+        // Without CAP_SYS_NICE, RLIMIT_RTPRIO is the highest realtime priority we may take
+        rlimit limit;
+
+        if (result == EPERM && getrlimit (RLIMIT_RTPRIO, &limit) == 0
+             && limit.rlim_cur != RLIM_INFINITY && static_cast<int> (limit.rlim_cur) >= minPriority)
+        {
+            if ((result = setPolicy (policy, static_cast<int> (limit.rlim_cur))) == 0)
+            {
+                applied.fellBack = true;
+                applied.errorCode = EPERM;
+            }
+        }
+       #endif
+    }
+
+    // Also takes the thread back off a realtime policy it was given before
+    if (settings.policy == Policy::normal || result != 0)
+    {
+        if (result != 0)
+        {
+            applied.fellBack = true;
+            applied.errorCode = result;
+        }
+
+        setPolicy (SCHED_OTHER, 0);
+    }
+
+    auto policy = SCHED_OTHER;
+    sched_param param {};
+
+    if (pthread_getschedparam (thread, &policy, &param) == 0)
+    {
+        applied.policy = policy == SCHED_FIFO ? Policy::fifo : (policy == SCHED_RR ? Policy::roundRobin : Policy::normal);
+        applied.nativePriority = param.sched_priority;
+    }
+
+   #if JUCE_LINUX
+    cpu_set_t cpus;
+    CPU_ZERO (&cpus);
+
+    // A mask of 0 allows every cpu, which also undoes an earlier mask
+    for (auto cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (settings.affinityMask == 0 || (cpu < 64 && (settings.affinityMask & (uint64 (1) << cpu)) != 0))
+            CPU_SET (cpu, &cpus);
+
+    if (const auto error = pthread_setaffinity_np (thread, sizeof (cpus), &cpus))
+    {
+        applied.fellBack = true;
+        applied.errorCode = error;
+    }
+
+    if (pthread_getaffinity_np (thread, sizeof (cpus), &cpus) == 0)
+        for (auto cpu = 0; cpu < 64; ++cpu)
+            if (CPU_ISSET (cpu, &cpus))
+                applied.affinityMask |= uint64 (1) << cpu;
+   #else
+    // Elsewhere there are at most affinity hints, which don't pin a thread to particular cpus
+    applied.fellBack = applied.fellBack || settings.affinityMask != 0;
+   #endif
+
+    return applied;
+}
+
+#endif
@@ -11,242 +11,1060 @@
 #pragma once
 
 #include "JuceHeader.h"
+#include "Utilities.h"
+#include "SpectrumAnalyser.h"
+#include "SpectrogramFile.h"
+#include "BinMapping.h"
+#include "PerformanceCounters.h"
+#include "AllocationGuard.h"
 
 class Visualizer : public Component, public Thread
 {
 public:
-    explicit Visualizer (int fftOrder) :
+    using OverflowPolicy = SpectrumAnalyser::OverflowPolicy;
+    using InputStats = SpectrumAnalyser::InputStats;
+    using Transform = SpectrumAnalyser::Transform;
+
+    enum class WakeupMode
+    {
+        polling,    // the fft thread checks for new samples once per millisecond
+        signalled   // the audio thread wakes the fft thread once a full hop of samples has arrived
+    };
+
+    struct LatencyStats
+    {
+        double lastMs {0.};
+        double averageMs {0.};
+        double maxMs {0.};
+        int64 numFrames {0};
+    };
+
+    struct SpectrumFrame
+    {
+        AudioBuffer<float> magnitudes;
+        int numBins {0};
+        int64 samplePosition {0};   // position of the first input sample in the analysed window
+        Transform transform {Transform::fft};
+    };
+
+    struct FrameInfo
+    {
+        int numBins {0};
+        int64 samplePosition {0};
+        Transform transform {Transform::fft};
+    };
+
+    /** How a view wants its spectra drawn, see setDisplayLayout (). */
+    struct DisplayLayout
+    {
+        int numPixels {0};      // 0 turns the display off
+        BinMapping::Scale scale {BinMapping::Scale::logarithmic};
+    };
+
+    struct DisplayInfo
+    {
+        int numPixels {0};
+        BinMapping::Scale scale {BinMapping::Scale::logarithmic};
+        int64 samplePosition {0};
+    };
+
+    static constexpr int maxNumDisplays = 4;
+    static constexpr int maxNumDisplayPixels = 4096;
+
+    /** How the fft thread is scheduled, see setThreadSettings (). */
+    struct ThreadSettings
+    {
+        enum class Policy
+        {
+            normal,     // the OS's ordinary time sharing
+            roundRobin, // realtime, taking turns with other realtime threads of the same priority
+            fifo        // realtime, running until it blocks
+        };
+
+        Policy policy {Policy::normal};
+        int priority {5};           // 0 to 10, spread over the policy's priorities (on Windows, normal uses it too)
+        uint64 affinityMask {0};    // bit n lets the thread run on cpu n, 0 for any cpu
+    };
+
+    /** How the fft thread is actually scheduled, see getThreadStatus (). */
+    struct ThreadStatus
+    {
+        ThreadSettings::Policy policy {ThreadSettings::Policy::normal};
+        int nativePriority {0};         // in the OS's own units
+        uint64 affinityMask {0};        // the cpus the thread may run on, 0 if the OS doesn't say
+        bool fellBack {false};          // something asked for wasn't permitted, so the thread carried on without it
+        int errorCode {0};              // the OS's error for the last thing that failed
+        PerformanceCounters::TimingSnapshot wakeupLatency;  // from a hop of samples arriving to the fft thread starting on it
+
+        String toString () const
+        {
+            const char* const policyNames[] = { "normal", "round robin", "fifo" };
+            auto text = String (policyNames[static_cast<int> (policy)]) + " priority " + String (nativePriority) + ", cpus "
+                         + (affinityMask != 0 ? "0x" + String::toHexString (static_cast<int64> (affinityMask)) : String ("any"));
+
+            if (fellBack)
+                text += ", fell back (error " + String (errorCode) + ")";
+
+            return text;
+        }
+    };
+
+    /** What the fft thread has been doing, see getPerformanceSnapshot (). */
+    struct PerformanceSnapshot
+    {
+        PerformanceCounters::TimingSnapshot analysis;   // reading the input and analysing one frame of one source
+        PerformanceCounters::TimingSnapshot publishing; // handing that frame to the readers, displays and recording
+        InputStats input;
+        int peakNumSamplesBuffered {0};     // the fullest the input ring has been when the fft thread woke
+        LatencyStats publishLatency;
+        int64 numRecordingFramesDropped {0};    // because the recording thread fell behind, see startRecording ()
+        ThreadStatus thread;
+    };
+
+    /** The spectra the Visualizer can produce, see SpectrumAnalyser::Source. */
+    enum Source
+    {
+        sumSource = SpectrumAnalyser::sumSource,
+        midSource = SpectrumAnalyser::midSource,
+        sideSource = SpectrumAnalyser::sideSource,
+        firstChannelSource = SpectrumAnalyser::firstChannelSource
+    };
+
+    static constexpr int minFftOrder = SpectrumAnalyser::minFftOrder;
+    static constexpr int maxFftOrder = SpectrumAnalyser::maxFftOrder;
+
+    explicit Visualizer (int fftOrder, int maxNumChannelsToUse = 2) :
         Thread ("fft"),
-        fft (fftOrder),
-        windowingFunction (static_cast<size_t> (fft.getSize ()), dsp::WindowingFunction<float>::hamming)
+        analyser (fftOrder, maxNumChannelsToUse)
     {
-        inputBuffer.setSize (1, 16384, false, true);
-        processingBuffer.setSize (1, 2 * fft.getSize (), false, true);
+        const auto sizeSpectrum = [this] (SpectrumFrame& f)
+        {
+            f.magnitudes.setSize (1, getMaxNumBins (), false, true);
+            f.numBins = getNumBins ();
+        };
+
+        for (auto source = 0; source < getNumSources (); ++source)
+        {
+            publishedFft.add (new TripleBuffer<SpectrumFrame> ())->initialiseAll (sizeSpectrum);
+            publishedMax.add (new TripleBuffer<SpectrumFrame> ())->initialiseAll (sizeSpectrum);
+            sourceUsers.add (0);
+        }
+
+        // The display frames are sized when a display is first turned on, see setDisplayLayout ()
+        for (auto& display : displays)
+        {
+            for (auto source = 0; source < getNumSources (); ++source)
+            {
+                display.fft.add (new TripleBuffer<DisplayFrame> ());
+                display.max.add (new TripleBuffer<DisplayFrame> ());
+                display.maxLayouts.add (0);
+            }
+        }
+
+        // Room for the dB conversion of a spectrum and a max, see publishDisplays ()
+        frameScratch.reserve (2 * ScratchArena::getSizeNeeded<float> (getMaxNumBins ()));
+
+        // Nothing is analysed until something acquires a source, see acquireSource ()
+        analyser.setSourceEnabled (sumSource, false);
 
-        fftOutputBuffer.setSize (1, fft.getSize () / 2, false, true);
-        fftMaxOutputBuffer.setSize (1, fft.getSize () / 2, false, true);
+        retiredRecordingTimer.setCallback ([this] () { retireRecording (nullptr); });
 
         startThread ();
     }
 
     ~Visualizer ()
     {
+        signalThreadShouldExit ();
+        wakeup.signal ();
         stopThread (3000);
+
+        stopRecording ();
+        recordingThread.stopThread (3000);
+    }
+
+    void setWakeupMode (WakeupMode newMode)
+    {
+        wakeupMode = newMode;
+        wakeup.signal ();
     }
 
-    void setSampleRate (double fs) {     sampleRate = fs;    }
-    double getSampleRate () const {     return sampleRate;    }
+    WakeupMode getWakeupMode () const {     return wakeupMode;    }
 
-    int getNumBins () const
+    /** Returns the time between the arrival of the most recent block of samples and the
+        publication of the spectrum that includes it. Safe to call from any thread.
+    */
+    LatencyStats getPublishLatency () const
     {
-        return fft.getSize () / 2;
+        LatencyStats stats;
+        stats.numFrames = latencyCount.load ();
+        stats.lastMs = 1000. * Time::highResolutionTicksToSeconds (latencyTicksLast.load ());
+        stats.maxMs = 1000. * Time::highResolutionTicksToSeconds (latencyTicksMax.load ());
+
+        if (stats.numFrames > 0)
+            stats.averageMs = 1000. * Time::highResolutionTicksToSeconds (latencyTicksTotal.load ()) / static_cast<double> (stats.numFrames);
+
+        return stats;
     }
 
-    void addSamples (const float* samples, int numSamples)
+    void resetPublishLatency ()
+    {
+        latencyResetRequested = true;
+    }
+
+    /** Returns the fft thread's timings along with the input and latency stats, for
+        logging or for an overlay. Safe to call from any thread, and cheap enough to call
+        for every frame drawn. The timings are empty if the counters are compiled out,
+        see PerformanceCounters.
+    */
+    PerformanceSnapshot getPerformanceSnapshot () const
+    {
+        PerformanceSnapshot snapshot;
+        snapshot.analysis = analysisTiming.getSnapshot ();
+        snapshot.publishing = publishTiming.getSnapshot ();
+        snapshot.input = getInputStats ();
+        snapshot.peakNumSamplesBuffered = peakNumSamplesBuffered.get ();
+        snapshot.publishLatency = getPublishLatency ();
+        snapshot.numRecordingFramesDropped = numRecordingFramesDropped.load ();
+        snapshot.thread = getThreadStatus ();
+        return snapshot;
+    }
+
+    void resetPerformanceCounters ()
+    {
+        analysisTiming.reset ();
+        publishTiming.reset ();
+        peakNumSamplesBuffered.reset ();
+        wakeupLatency.reset ();
+        resetPublishLatency ();
+    }
+
+    /** Returns when the samples that completed the latest published frame arrived, in
+        high resolution ticks, so a view can measure how long they took to reach the screen.
+    */
+    int64 getPublishedArrivalTicks () const noexcept
+    {
+        return publishedArrivalTicks.load ();
+    }
+
+    /** Sizes the input ring for the given sample rate and largest block size. The fft thread
+        is stopped while the ring is reallocated, so don't call this while samples are being added.
+        Sample positions start again from zero, so any recording is stopped.
+    */
+    void prepareToPlay (double fs, int maximumBlockSize)
+    {
+        signalThreadShouldExit ();
+        wakeup.signal ();
+        stopThread (3000);
+        stopRecording ();
+
+        analyser.prepare (fs, maximumBlockSize);
+        samplesSinceWakeup = 0;
+
+        startThread ();
+    }
+
+    /** Chooses how the fft thread is scheduled. The thread applies the settings to itself
+        before its next frame, and again whenever it's restarted.
+
+        The realtime policies usually need privileges. On Linux that means CAP_SYS_NICE or an
+        RLIMIT_RTPRIO, e.g. from limits.conf, and with only the rlimit the priority is
+        lowered to it. Anything that isn't permitted is left as it was, the thread carries
+        on regardless, and getThreadStatus () reports what happened. Affinity is only
+        supported on Linux and Windows. Call this from the same thread each time.
+    */
+    void setThreadSettings (const ThreadSettings& newSettings)
     {
-        jassert (sampleRate > 0.);
-        fifo.addToFifo (samples, numSamples);
+        requestedThreadSettings = newSettings;
+        threadSettings.getWriteBuffer () = newSettings;
+        threadSettings.publish ();
+        wakeup.signal ();
     }
 
-    void copyCurrentFft (float* samples, int numSamples) const
+    /** Returns the settings last asked for. Call this from the thread that sets them. */
+    const ThreadSettings& getThreadSettings () const
     {
-        jassert (numSamples == fft.getSize () / 2);
-        ScopedLock lock (processingLock);
-        FloatVectorOperations::copy (samples, fftOutputBuffer.getReadPointer (0), numSamples);
+        return requestedThreadSettings;
     }
 
-    bool getMaxHasChanged ()
+    /** Returns the policy, priority and cpus the fft thread is really running with, and
+        how long it has been taking to wake for each hop. Safe to call from any thread.
+    */
+    ThreadStatus getThreadStatus () const
+    {
+        ThreadStatus status;
+        status.policy = static_cast<ThreadSettings::Policy> (appliedPolicy.load ());
+        status.nativePriority = appliedPriority.load ();
+        status.affinityMask = appliedAffinityMask.load ();
+        status.fellBack = appliedFellBack.load ();
+        status.errorCode = appliedErrorCode.load ();
+        status.wakeupLatency = wakeupLatency.getSnapshot ();
+        return status;
+    }
+
+    void setSampleRate (double fs) {     analyser.setSampleRate (fs);    }
+    double getSampleRate () const {     return analyser.getSampleRate ();    }
+
+    void setOverflowPolicy (OverflowPolicy newPolicy)   { analyser.setOverflowPolicy (newPolicy); }
+    OverflowPolicy getOverflowPolicy () const           { return analyser.getOverflowPolicy (); }
+
+    /** Returns the input ring's counters. Safe to call from any thread. */
+    InputStats getInputStats () const
     {
-        ScopedLock lock (processingLock);
-        if (! maxHasChanged)
+        return analyser.getInputStats ();
+    }
+
+    /** Asks the fft thread to switch to a new fft size. The published frames report
+        their own number of bins, so readers pick up the change with the next frame.
+    */
+    void setFftOrder (int newOrder)
+    {
+        analyser.setFftOrder (newOrder);
+        wakeup.signal ();
+    }
+
+    /** Switches the fft thread between the fft and the constant-Q analysis, see
+        SpectrumAnalyser::setTransform (). The frames say which they came from, and
+        getBinSpacing () tells a view how to map them.
+    */
+    void setTransform (Transform newTransform)
+    {
+        analyser.setTransform (newTransform);
+        wakeup.signal ();
+    }
+
+    Transform getTransform () const     { return analyser.getTransform (); }
+
+    /** Chooses the resolution and range of the constant-Q analysis, see ConstantQ. */
+    void setConstantQ (const ConstantQ::Settings& newSettings)  { analyser.setConstantQ (newSettings); }
+    ConstantQ::Settings getConstantQ () const                   { return analyser.getConstantQ (); }
+
+    /** The constant-Q bins are already spaced evenly in log frequency. */
+    static BinMapping::BinSpacing getBinSpacing (Transform transform)
+    {
+        return transform == Transform::constantQ ? BinMapping::BinSpacing::logarithmic : BinMapping::BinSpacing::linear;
+    }
+
+    /** Chooses which fft implementation the fft thread uses from the next frame on. */
+    void setFftEngine (FftEngine::Type newType)     { analyser.setFftEngine (newType); }
+    FftEngine::Type getFftEngine () const           { return analyser.getFftEngine (); }
+
+    /** Changes the attack, release and peak hold of the displayed spectra. Call this from
+        the same thread each time, the fft thread picks the settings up on its next frame.
+    */
+    void setBallistics (const Ballistics::Settings& newSettings)
+    {
+        analyser.setBallistics (newSettings);
+    }
+
+    /** Chooses the analysis window and how the magnitudes are calibrated. The tables are
+        built on the calling thread, and the fft thread switches to them with its next frame.
+    */
+    void setWindow (const WindowFunction::Settings& newSettings)    { analyser.setWindow (newSettings); }
+    const WindowFunction::Settings& getWindow () const              { return analyser.getWindow (); }
+    WindowFunction::Properties getWindowProperties () const         { return analyser.getWindowProperties (getFftOrder ()); }
+
+    int getFftOrder () const            { return analyser.getFftOrder (); }
+    int getFftSize () const             { return analyser.getFftSize (); }
+    int getNumBins () const             { return analyser.getNumBins (); }
+    static int getMaxNumBins ()         { return SpectrumAnalyser::getMaxNumBins (); }
+
+    void setHopSize (int newHopSize)    { analyser.setHopSize (newHopSize); }
+    int getHopSize () const             { return analyser.getHopSize (); }
+    void setOverlap (float newOverlap)  { analyser.setOverlap (newOverlap); }
+
+    int getMaxNumChannels () const      { return analyser.getMaxNumChannels (); }
+    int getNumSources () const          { return analyser.getNumSources (); }
+
+    static String getSourceName (int source)
+    {
+        return SpectrumAnalyser::getSourceName (source);
+    }
+
+    /** Only sources that something is using are analysed, so the cost per frame grows with
+        the number of spectra actually being looked at. Views, recordings and anything else
+        sharing the Visualizer each acquire the sources they need and release them when
+        they're done, and a source stays on until the last of them has released it. Call
+        these from the message thread.
+    */
+    void acquireSource (int source)
+    {
+        jassert (source >= 0 && source < getNumSources ());
+
+        if (sourceUsers.getReference (source)++ == 0)
+            analyser.setSourceEnabled (source, true);
+    }
+
+    void releaseSource (int source)
+    {
+        auto& numUsers = sourceUsers.getReference (source);
+        jassert (numUsers > 0);     // released more often than it was acquired
+
+        if (numUsers > 0 && --numUsers == 0)
+            analyser.setSourceEnabled (source, false);
+    }
+
+    bool isSourceEnabled (int source) const     { return analyser.isSourceEnabled (source); }
+
+    /** Starts streaming the raw magnitudes of every frame of the enabled sources into a
+        spectrogram file, replacing any recording in progress. The recording holds on to its
+        sources until it's finished, so a view switching away can't cut them out of the file.
+        Sources enabled later aren't recorded, and the recording stops by itself if the fft size or hop size changes.
+        Spectrogram files hold fft bins, so it stops on a switch to constant-Q too, and
+        can't be started during one. Returns false if the file couldn't be created.
+
+        The fft thread only copies each frame into a fifo, and a normal priority thread
+        writes them to the file, so a realtime fft thread never waits on the disk. The fifo
+        holds a couple of seconds of frames, and if the disk falls further behind than that
+        frames are dropped and counted, see getPerformanceSnapshot (). The fft thread finds
+        the recording through an atomic pointer, so it never waits on these calls either.
+
+        Call startRecording (), stopRecording () and isRecording () from the message thread.
+    */
+    bool startRecording (const File& file, SpectrogramFile::Encoding encoding = SpectrogramFile::Encoding::float16)
+    {
+        if (getTransform () != Transform::fft)
             return false;
 
-        maxHasChanged = false;
+        SpectrogramFile::Layout layout;
+        layout.sampleRate = getSampleRate ();
+        layout.fftSize = getFftSize ();
+        layout.hopSize = getHopSize ();
+
+        for (auto source = 0; source < getNumSources (); ++source)
+            if (isSourceEnabled (source))
+                layout.sources.add (source);
+
+        if (layout.sources.size () == 0)
+            return false;
+
+        std::unique_ptr<SpectrogramWriter> writer (new SpectrogramWriter (file, layout, encoding));
+
+        if (! writer->openedOk ())
+            return false;
+
+        const auto numFrames = jmax (16, roundToInt (Recording::maxQueuedSeconds * layout.sampleRate / layout.hopSize));
+        std::unique_ptr<Recording> newRecording (new Recording (layout, std::move (writer), numFrames * layout.sources.size ()));
+
+        for (auto source : layout.sources)
+            acquireSource (source);
+
+        if (! recordingThread.isThreadRunning ())
+            recordingThread.startThread ();
+
+        recordingThread.addTimeSliceClient (newRecording.get ());
+
+        activeRecording = newRecording.get ();
+        recording.swap (newRecording);
+
+        // The old recording, now in newRecording, is finished once the fft thread has let go of it
+        retireRecording (std::move (newRecording));
         return true;
     }
 
+    void stopRecording ()
+    {
+        activeRecording = nullptr;
+        retireRecording (std::move (recording));
+    }
+
+    bool isRecording () const
+    {
+        return recording != nullptr && ! recording->isStopped ();
+    }
+
+    void addSamples (const float* samples, int numSamples)
+    {
+        addSamples (&samples, 1, numSamples);
+    }
+
+    /** Adds planar samples, one pointer per channel. Channels beyond getMaxNumChannels () are ignored. */
+    void addSamples (const float* const* channelData, int numChannels, int numSamples)
+    {
+        jassert (getSampleRate () > 0.);
+        analyser.addSamples (channelData, numChannels, numSamples);
+        samplesAdded (numSamples);
+    }
+
+    void addSamples (const AudioBuffer<float>& buffer, int startSample, int numSamples)
+    {
+        jassert (getSampleRate () > 0.);
+        analyser.addSamples (buffer, startSample, numSamples);
+        samplesAdded (numSamples);
+    }
+
+    /** Adds interleaved samples, numChannels to each sample frame. */
+    void addInterleavedSamples (const float* samples, int numChannels, int numSamples)
+    {
+        jassert (getSampleRate () > 0.);
+        analyser.addInterleavedSamples (samples, numChannels, numSamples);
+        samplesAdded (numSamples);
+    }
+
+    /** Goes up each time a spectrum or max is published, so a view can tell whether
+        there's anything new to draw without copying it.
+    */
+    uint32 getFrameSequence () const noexcept
+    {
+        return frameSequence.load ();
+    }
+
+    // The spectrum readers below are wait-free, but they must all be called from the
+    // same consumer thread (normally the message thread).
+
+    /** Copies up to maxNumBins of the latest spectrum and returns its size and the sample
+        position at which its window started.
+    */
+    FrameInfo copyCurrentFft (float* samples, int maxNumBins, int source = sumSource)
+    {
+        auto& channel = *publishedFft.getUnchecked (source);
+        channel.acquire ();
+        return copyFrame (channel.getReadBuffer (), samples, maxNumBins);
+    }
+
+    bool getMaxHasChanged (int source = sumSource)
+    {
+        return publishedMax.getUnchecked (source)->acquire ();
+    }
+
+    /** Asks the fft thread to clear the max, the cleared max is then published as a change. */
     void resetMax ()
     {
-        ScopedLock lock (processingLock);
-        fftMaxOutputBuffer.clear ();
-        maxHasChanged = true;
+        resetMaxRequested = true;
+        wakeup.signal ();
     }
 
-    void copyCurrentMax (float* samples, int numSamples) const
+    /** Copies up to maxNumBins of the max spectrum and returns its size and the sample
+        position of the frame that last changed it.
+    */
+    FrameInfo copyCurrentMax (float* samples, int maxNumBins, int source = sumSource)
     {
-        jassert (numSamples == fft.getSize () / 2);
-        ScopedLock lock (processingLock);
-        FloatVectorOperations::copy (samples, fftMaxOutputBuffer.getReadPointer (0), numSamples);
+        auto& channel = *publishedMax.getUnchecked (source);
+        channel.acquire ();
+        return copyFrame (channel.getReadBuffer (), samples, maxNumBins);
     }
 
-private:
-    void run () override
+    /** Asks the fft thread to publish the spectra already converted to the display's
+        relative dB and mapped onto numPixels pixels, so a view only has to copy and paint
+        them. Up to maxNumDisplays views can each have their own layout. The layout is
+        handed over through an atomic, so this is fine to call from resized (), and the
+        fft thread picks it up with its next frame.
+
+        The frames are allocated here the first time the display is turned on, so that the
+        fft thread never allocates. Layouts wider than maxNumDisplayPixels turn the display
+        off, and the view has to convert the spectra itself.
+    */
+    void setDisplayLayout (int display, DisplayLayout layout)
     {
-        while (! threadShouldExit ())
+        jassert (display >= 0 && display < maxNumDisplays);
+        auto& d = displays[static_cast<size_t> (display)];
+
+        if (layout.numPixels > maxNumDisplayPixels)
+            layout.numPixels = 0;
+
+        // The fft thread doesn't touch a display until it has a layout, so until then it's safe to size it here
+        if (layout.numPixels > 0 && ! d.isAllocated)
         {
-            const auto numReady = fifo.abstractFifo.getNumReady ();
-            if (numReady > 0)
+            const auto sizeFrame = [] (DisplayFrame& f) { f.values.resize (static_cast<size_t> (maxNumDisplayPixels)); };
+
+            for (auto source = 0; source < getNumSources (); ++source)
             {
-                addToInputBuffer (numReady);
-                perform ();
+                d.fft.getUnchecked (source)->initialiseAll (sizeFrame);
+                d.max.getUnchecked (source)->initialiseAll (sizeFrame);
             }
 
-            sleep (1);
+            d.mapping.reserve (maxNumDisplayPixels);
+            d.isAllocated = true;
         }
+
+        d.requestedLayout = packLayout (layout);
     }
 
-    void addToInputBuffer (int numSamples)
+    // Like the spectrum readers, these must all be called from the same consumer thread.
+
+    /** Copies up to maxNumPixels of the latest display frame. The frame reports the layout
+        it was rendered for, which won't match a new layout until the fft thread has caught
+        up with it.
+    */
+    DisplayInfo copyDisplayFft (int display, float* values, int maxNumPixels, int source = sumSource)
     {
-        const auto bufferSize = inputBuffer.getNumSamples ();
-        if (writePointer + numSamples < bufferSize)
-        {
-            fifo.readFromFifo (inputBuffer.getWritePointer (0, writePointer), numSamples);
-            writePointer += numSamples;
-        }
-        else
-        {
-            const auto numToCopy1 = bufferSize - writePointer;
-            fifo.readFromFifo (inputBuffer.getWritePointer (0, writePointer), numToCopy1);
+        auto& channel = *displays[static_cast<size_t> (display)].fft.getUnchecked (source);
+        channel.acquire ();
+        return copyDisplayFrame (channel.getReadBuffer (), values, maxNumPixels);
+    }
 
-            const auto numToCopy2 = numSamples - numToCopy1;
-            fifo.readFromFifo (inputBuffer.getWritePointer (0), numToCopy2);
+    bool getDisplayMaxHasChanged (int display, int source = sumSource)
+    {
+        return displays[static_cast<size_t> (display)].max.getUnchecked (source)->acquire ();
+    }
 
-            writePointer = numToCopy2;
-        }
+    DisplayInfo copyDisplayMax (int display, float* values, int maxNumPixels, int source = sumSource)
+    {
+        auto& channel = *displays[static_cast<size_t> (display)].max.getUnchecked (source);
+        channel.acquire ();
+        return copyDisplayFrame (channel.getReadBuffer (), values, maxNumPixels);
     }
 
-    void readFromInputBuffer (float* destination, int numSamples)
+private:
+    /** A counting semaphore whose signal () is safe to call from the audio thread. */
+    class Wakeup
     {
-        const auto bufferSize = inputBuffer.getNumSamples ();
+    public:
+        Wakeup ();
+        ~Wakeup ();
 
-        if (readPointer + numSamples < bufferSize)
-        {
-            FloatVectorOperations::copy (destination, inputBuffer.getReadPointer (0, readPointer), numSamples);
-            readPointer += numSamples;
-        }
-        else
-        {
-            const auto numToCopy1 = bufferSize - readPointer;
-            FloatVectorOperations::copy (destination, inputBuffer.getReadPointer (0, readPointer), numToCopy1);
+        void signal () noexcept;
+        bool wait (int timeoutMilliseconds) noexcept;
 
-            const auto numToCopy2 = numSamples - numToCopy1;
-            FloatVectorOperations::copy (destination + numToCopy1, inputBuffer.getReadPointer (0), numToCopy2);
+    private:
+        struct Pimpl;
+        std::unique_ptr<Pimpl> pimpl;
 
-            readPointer = numToCopy2;
-        }
+        JUCE_DECLARE_NON_COPYABLE (Wakeup)
+    };
+
+    /** What applyToCurrentThread () managed to set. */
+    struct AppliedThreadSettings
+    {
+        ThreadSettings::Policy policy {ThreadSettings::Policy::normal};
+        int nativePriority {0};
+        uint64 affinityMask {0};
+        bool fellBack {false};
+        int errorCode {0};
+    };
+
+    /** Schedules the calling thread as the settings ask, as far as it's permitted to, and
+        reads back what it got. Doesn't allocate, so the fft thread can call it.
+    */
+    static AppliedThreadSettings applyToCurrentThread (const ThreadSettings& settings) noexcept;
+
+    void applyThreadSettings (const ThreadSettings& settings) noexcept
+    {
+        const auto applied = applyToCurrentThread (settings);
+        appliedPolicy = static_cast<int> (applied.policy);
+        appliedPriority = applied.nativePriority;
+        appliedAffinityMask = applied.affinityMask;
+        appliedFellBack = applied.fellBack;
+        appliedErrorCode = applied.errorCode;
+    }
+
+    static FrameInfo copyFrame (const SpectrumFrame& frame, float* samples, int maxNumBins)
+    {
+        const auto numBins = jmin (frame.numBins, maxNumBins);
+        FloatVectorOperations::copy (samples, frame.magnitudes.getReadPointer (0), numBins);
+        return { numBins, frame.samplePosition, frame.transform };
+    }
+
+    struct DisplayFrame
+    {
+        std::vector<float> values;
+        int numPixels {0};
+        BinMapping::Scale scale {BinMapping::Scale::logarithmic};
+        int64 samplePosition {0};
+    };
+
+    struct Display
+    {
+        std::atomic<int> requestedLayout {0};
+        BinMapping mapping;
+        OwnedArray<TripleBuffer<DisplayFrame>> fft;
+        OwnedArray<TripleBuffer<DisplayFrame>> max;
+        Array<int> maxLayouts;      // the layout each source's max was last rendered with
+        bool isAllocated {false};   // only used by setDisplayLayout ()
+    };
+
+    static int packLayout (DisplayLayout layout)
+    {
+        return jmax (0, layout.numPixels) * 2 + (layout.scale == BinMapping::Scale::linear ? 1 : 0);
     }
 
-    void copyFromFftBufferToInputBuffer ()
+    static DisplayInfo copyDisplayFrame (const DisplayFrame& frame, float* values, int maxNumPixels)
     {
-        const auto fftSize = fft.getSize ();
-        processingBuffer.clear ();
-        readFromInputBuffer (processingBuffer.getWritePointer (0), fftSize);
-        windowingFunction.multiplyWithWindowingTable (processingBuffer.getWritePointer (0),
-                                                      static_cast<size_t> (fftSize));
+        const auto numPixels = jmin (frame.numPixels, maxNumPixels);
+        FloatVectorOperations::copy (values, frame.values.data (), numPixels);
+        return { frame.numPixels, frame.scale, frame.samplePosition };
     }
 
-    void perform ()
+    /** Renders a frame for every display that's turned on. The dB conversion is done once
+        and shared, so a display only costs its mapping.
+    */
+    void publishDisplays (const SpectrumAnalyser::Frame& frame)
     {
-        while (getWrappedDistanceBetweenPointers () > fft.getSize ())
+        frameScratch.reset ();
+        float* fftDecibels = nullptr;
+        float* maxDecibels = nullptr;
+
+        for (auto& display : displays)
         {
-            copyFromFftBufferToInputBuffer ();
-            fft.performFrequencyOnlyForwardTransform (processingBuffer.getWritePointer (0));
-            applyBalisticsAndCopyToOutput ();
+            const auto layout = display.requestedLayout.load ();
+            const auto numPixels = layout / 2;
+
+            if (numPixels == 0)
+                continue;
+
+            display.mapping.update (numPixels, frame.numBins, (layout & 1) != 0 ? BinMapping::Scale::linear : BinMapping::Scale::logarithmic,
+                                    getBinSpacing (frame.transform));
+
+            if (fftDecibels == nullptr)
+            {
+                fftDecibels = frameScratch.allocate<float> (frame.numBins);
+                BinMapping::toRelativeDecibels (frame.magnitudes, fftDecibels, frame.numBins);
+            }
+
+            publishDisplay (*display.fft.getUnchecked (frame.source), display.mapping, fftDecibels, frame.samplePosition);
+
+            // A new layout needs the max too, even if it hasn't changed
+            auto& maxLayout = display.maxLayouts.getReference (frame.source);
+
+            if (frame.maxChanged || maxLayout != layout)
+            {
+                if (maxDecibels == nullptr)
+                {
+                    maxDecibels = frameScratch.allocate<float> (frame.numBins);
+                    BinMapping::toRelativeDecibels (frame.max, maxDecibels, frame.numBins);
+                }
+
+                publishDisplay (*display.max.getUnchecked (frame.source), display.mapping, maxDecibels, frame.samplePosition);
+                maxLayout = layout;
+            }
         }
     }
 
-    void applyBalisticsAndCopyToOutput ()
+    /** Makes every display re-render the max of a source with its next frame. */
+    void invalidateDisplayMax (int source)
     {
-        ScopedLock sl (processingLock);
-        const auto input = processingBuffer.getWritePointer (0);
-        const auto output = fftOutputBuffer.getWritePointer (0);
-        const auto maxOutput = fftMaxOutputBuffer.getWritePointer (0);
+        for (auto& display : displays)
+            display.maxLayouts.set (source, 0);
+    }
 
-        const auto decayRate = Decibels::decibelsToGain (-40.f * static_cast<float> (fft.getSize ()) / static_cast<float> (sampleRate));
+    static void publishDisplay (TripleBuffer<DisplayFrame>& channel, const BinMapping& mapping, const float* dB, int64 samplePosition)
+    {
+        auto& displayFrame = channel.getWriteBuffer ();
+        const auto numPixels = mapping.getNumPixels ();
+        jassert (displayFrame.values.size () >= static_cast<size_t> (numPixels));
 
-        for (auto n = 0 ; n < fftOutputBuffer.getNumSamples (); ++n)
+        mapping.render (dB, displayFrame.values.data ());
+        displayFrame.numPixels = numPixels;
+        displayFrame.scale = mapping.getScale ();
+        displayFrame.samplePosition = samplePosition;
+        channel.publish ();
+    }
+
+    void run () override
+    {
+        // Everything the fft thread needs is allocated up front or by the thread that configures it
+        const AllocationGuard::ScopedNoAllocation noAllocation;
+
+        threadSettings.acquire ();
+        applyThreadSettings (threadSettings.getReadBuffer ());
+
+        while (! threadShouldExit ())
         {
-            if (input[n] > output[n])
+            if (threadSettings.acquire ())
+                applyThreadSettings (threadSettings.getReadBuffer ());
+
+            const auto readyTicks = hopReadyTicks.exchange (0);
+
+            if (readyTicks != 0)
+                wakeupLatency.record (PerformanceCounters::getTicks () - readyTicks);
+
+            if (resetMaxRequested.exchange (false))
+            {
+                analyser.clearMax ();
+
+                for (auto source = 0; source < getNumSources (); ++source)
+                {
+                    const auto& ballistics = analyser.getBallistics (source);
+                    publish (*publishedMax.getUnchecked (source), ballistics.getMax (), ballistics.getNumBins (), analyser.getNextFrameStart (), analyser.getTransform ());
+                    invalidateDisplayMax (source);
+                }
+
+                ++frameSequence;
+            }
+
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            peakNumSamplesBuffered.record (analyser.getInputStats ().numSamplesBuffered);
+           #endif
+
+            // Each frame's analysis runs from the end of the previous callback to the start of its own
+            const auto arrivalTicks = lastArrivalTicks.load ();
+            auto frameStartTicks = PerformanceCounters::getTicks ();
+
+            const auto numFrames = analyser.perform ([this, &frameStartTicks] (const SpectrumAnalyser::Frame& frame)
+            {
+                const auto publishStartTicks = PerformanceCounters::getTicks ();
+                analysisTiming.record (publishStartTicks - frameStartTicks);
+
+                publish (*publishedFft.getUnchecked (frame.source), frame.magnitudes, frame.numBins, frame.samplePosition, frame.transform);
+
+                if (frame.maxChanged)
+                    publish (*publishedMax.getUnchecked (frame.source), frame.max, frame.numBins, frame.samplePosition, frame.transform);
+
+                publishDisplays (frame);
+                ++frameSequence;
+                record (frame);
+
+                frameStartTicks = PerformanceCounters::getTicks ();
+                publishTiming.record (frameStartTicks - publishStartTicks);
+            });
+
+            if (numFrames > 0)
             {
-                output[n] = input[n];
+                updatePublishLatency (Time::getHighResolutionTicks () - arrivalTicks);
+                publishedArrivalTicks = arrivalTicks;
             }
+
+            if (wakeupMode == WakeupMode::signalled)
+                wakeup.wait (100);
             else
-                output[n] *= decayRate;
+                sleep (1);
+        }
+    }
 
+    void samplesAdded (int numSamples)
+    {
+        lastArrivalTicks.store (Time::getHighResolutionTicks ());
 
-            if (input[n] > maxOutput[n])
+        // Only the audio thread touches samplesSinceWakeup, and signalling the
+        // semaphore never blocks, so this path stays wait-free.
+        samplesSinceWakeup += numSamples;
+        if (samplesSinceWakeup >= getHopSize ())
+        {
+            samplesSinceWakeup %= getHopSize ();
+
+            // Only the first hop the fft thread hasn't started on is timed, so a slow wakeup isn't understated
+            if (PerformanceCounters::enabled)
             {
-                maxOutput[n] = input[n];
-                maxHasChanged = true;
+                auto noHopWaiting = int64 (0);
+                hopReadyTicks.compare_exchange_strong (noHopWaiting, PerformanceCounters::getTicks ());
             }
+
+            if (wakeupMode == WakeupMode::signalled)
+                wakeup.signal ();
+        }
+    }
+
+    void updatePublishLatency (int64 ticks)
+    {
+        if (latencyResetRequested.exchange (false))
+        {
+            latencyTicksTotal = 0;
+            latencyTicksMax = 0;
+            latencyCount = 0;
         }
+
+        latencyTicksLast = ticks;
+        latencyTicksTotal += ticks;
+        latencyTicksMax = jmax (latencyTicksMax.load (), ticks);
+        ++latencyCount;
     }
 
-    int getWrappedDistanceBetweenPointers () const
+    void record (const SpectrumAnalyser::Frame& frame)
     {
-        if (writePointer > readPointer)
-            return writePointer - readPointer;
+        // Keeps the message thread from deleting the recording while it's used here, see retireRecording ()
+        recordingInUse = true;
 
-        return inputBuffer.getNumSamples () - readPointer + writePointer;
+        if (auto* current = activeRecording.load ())
+            record (*current, frame);
+
+        recordingInUse = false;
+    }
+
+    static void publish (TripleBuffer<SpectrumFrame>& channel, const float* source, int numBins, int64 samplePosition, Transform transform)
+    {
+        auto& frame = channel.getWriteBuffer ();
+        FloatVectorOperations::copy (frame.magnitudes.getWritePointer (0), source, numBins);
+        frame.numBins = numBins;
+        frame.samplePosition = samplePosition;
+        frame.transform = transform;
+        channel.publish ();
     }
 
+    SpectrumAnalyser analyser;
+    Array<int> sourceUsers;     // how many acquireSource () calls each source has outstanding
 
-    struct Fifo
+    OwnedArray<TripleBuffer<SpectrumFrame>> publishedFft;
+    OwnedArray<TripleBuffer<SpectrumFrame>> publishedMax;
+    std::atomic<bool> resetMaxRequested {false};
+    std::atomic<uint32> frameSequence {0};
+
+    std::array<Display, maxNumDisplays> displays;
+    ScratchArena frameScratch;     // the fft thread's temporaries for one frame
+
+    /** A recording in progress. The fft thread push ()es each frame of each source into the
+        fifo, and the recording thread drains them into the writer.
+    */
+    class Recording : public TimeSliceClient
     {
-        void addToFifo (const float* someData, int numItems)
+    public:
+        static constexpr double maxQueuedSeconds = 2.;
+
+        Recording (const SpectrogramFile::Layout& layoutToUse, std::unique_ptr<SpectrogramWriter> writerToUse, int maxNumQueued) :
+            layout (layoutToUse),
+            numBins (writerToUse->getNumBins ()),
+            writer (std::move (writerToUse)),
+            fifo (maxNumQueued + 1)
+        {
+            positions.resize (static_cast<size_t> (fifo.getTotalSize ()));
+            slots.resize (positions.size ());
+            magnitudes.resize (positions.size () * static_cast<size_t> (numBins));
+        }
+
+        ~Recording () override
+        {
+            drain ();
+            writer->finish ();
+        }
+
+        /** Called on the fft thread. Returns false if the fifo is full and the frame was dropped. */
+        bool push (int64 samplePosition, int slot, const float* values) noexcept
         {
             int start1, size1, start2, size2;
-            abstractFifo.prepareToWrite (numItems, start1, size1, start2, size2);
+            fifo.prepareToWrite (1, start1, size1, start2, size2);
 
-            if (size1 > 0)
-                copySomeData (myBuffer.data () + start1, someData, size1);
+            if (size1 == 0)
+                return false;
 
-            if (size2 > 0)
-                copySomeData (myBuffer.data () + start2, someData + size1, size2);
+            positions[static_cast<size_t> (start1)] = samplePosition;
+            slots[static_cast<size_t> (start1)] = slot;
+            FloatVectorOperations::copy (magnitudes.data () + start1 * numBins, values, numBins);
+            fifo.finishedWrite (1);
+            return true;
+        }
+
+        /** Called on the fft thread when the recording can't go on. */
+        void stop () noexcept               { stopped = true; }
+        bool isStopped () const noexcept    { return stopped; }
 
-            abstractFifo.finishedWrite (size1 + size2);
+        int useTimeSlice () override
+        {
+            // Everything is pushed before stopped is set, so once it's been seen, this drain gets the lot
+            const auto wasStopped = stopped.load ();
+            drain ();
+
+            if (wasStopped)
+            {
+                writer->finish ();
+                return 500;
+            }
+
+            return 20;
         }
 
-        void readFromFifo (float* someData, int numItems)
+        const SpectrogramFile::Layout layout;
+        const int numBins;
+
+    private:
+        void drain ()
         {
             int start1, size1, start2, size2;
-            abstractFifo.prepareToRead (numItems, start1, size1, start2, size2);
+            fifo.prepareToRead (fifo.getNumReady (), start1, size1, start2, size2);
 
-            if (size1 > 0)
-                copySomeData (someData, myBuffer.data() + start1, size1);
+            for (auto i = start1; i < start1 + size1; ++i)
+                write (i);
 
-            if (size2 > 0)
-                copySomeData (someData + size1, myBuffer.data() + start2, size2);
+            for (auto i = start2; i < start2 + size2; ++i)
+                write (i);
 
-            abstractFifo.finishedRead (size1 + size2);
+            fifo.finishedRead (size1 + size2);
         }
 
-        void copySomeData (float* dest, const float* source, int numItems) const
+        void write (int index)
         {
-            FloatVectorOperations::copy (dest, source, numItems);
+            writer->writeSource (positions[static_cast<size_t> (index)], slots[static_cast<size_t> (index)], magnitudes.data () + index * numBins);
         }
 
-        AbstractFifo abstractFifo { 4096 };
-        std::array<float, 4096> myBuffer{};
+        std::unique_ptr<SpectrogramWriter> writer;
+        AbstractFifo fifo;
+        std::vector<int64> positions;
+        std::vector<int> slots;
+        std::vector<float> magnitudes;
+        std::atomic<bool> stopped {false};
+
+        JUCE_DECLARE_NON_COPYABLE (Recording)
     };
 
-    Fifo fifo;
+    void record (Recording& current, const SpectrumAnalyser::Frame& frame)
+    {
+        if (current.isStopped ())
+            return;
+
+        // The recording thread closes the file once it has written what's queued
+        if (frame.transform != Transform::fft || frame.numBins != current.numBins || getHopSize () != current.layout.hopSize)
+        {
+            current.stop ();
+            return;
+        }
+
+        const auto slot = current.layout.sources.indexOf (frame.source);
+
+        if (slot >= 0 && ! current.push (frame.samplePosition, slot, frame.rawMagnitudes))
+            ++numRecordingFramesDropped;
+    }
+
+    /** Finishes a recording that's been swapped out of activeRecording, along with any
+        still waiting. The fft thread may have picked one up just before the swap, so they
+        are only finished once it's been seen outside record (), which is checked again on
+        a timer until it has. Both sides use sequentially consistent atomics, so once the
+        fft thread is seen outside, it can only pick up the new pointer.
+    */
+    void retireRecording (std::unique_ptr<Recording> oldRecording)
+    {
+        if (oldRecording != nullptr)
+            retiredRecordings.add (oldRecording.release ());
 
-    double sampleRate {0.};
+        if (recordingInUse)
+        {
+            if (! retiredRecordingTimer.isTimerRunning ())
+                retiredRecordingTimer.startTimer (10);
+
+            return;
+        }
 
-    AudioBuffer<float> processingBuffer;
-    AudioBuffer<float> fftOutputBuffer;
-    AudioBuffer<float> fftMaxOutputBuffer;
-    AudioBuffer<float> inputBuffer;
+        retiredRecordingTimer.stopTimer ();
+
+        // Each recording writes whatever it still has queued as it's deleted
+        for (auto* retired : retiredRecordings)
+        {
+            recordingThread.removeTimeSliceClient (retired);
+
+            for (auto source : retired->layout.sources)
+                releaseSource (source);
+        }
+
+        retiredRecordings.clear ();
+    }
 
-    dsp::FFT fft;
+    std::unique_ptr<Recording> recording;               // only used on the message thread
+    std::atomic<Recording*> activeRecording {nullptr};  // what the fft thread records into
+    std::atomic<bool> recordingInUse {false};
+    OwnedArray<Recording> retiredRecordings;
+    LambdaTimer retiredRecordingTimer;
+    TimeSliceThread recordingThread {"recording"};
+    std::atomic<int64> numRecordingFramesDropped {0};
 
-    dsp::WindowingFunction<float> windowingFunction;
+    Wakeup wakeup;
+    std::atomic<WakeupMode> wakeupMode {WakeupMode::signalled};
+    int samplesSinceWakeup {0};
 
-    bool maxHasChanged {false};
+    std::atomic<int64> lastArrivalTicks {0};
+    std::atomic<int64> latencyTicksLast {0};
+    std::atomic<int64> latencyTicksTotal {0};
+    std::atomic<int64> latencyTicksMax {0};
+    std::atomic<int64> latencyCount {0};
+    std::atomic<bool> latencyResetRequested {false};
+    std::atomic<int64> publishedArrivalTicks {0};
 
-    int writePointer {0};
-    int readPointer {0};
+    PerformanceCounters::Timing analysisTiming;
+    PerformanceCounters::Timing publishTiming;
+    PerformanceCounters::Peak peakNumSamplesBuffered;
 
-    CriticalSection processingLock;
-};
\ No newline at end of file
+    ThreadSettings requestedThreadSettings;
+    TripleBuffer<ThreadSettings> threadSettings;
+    std::atomic<int> appliedPolicy {0};
+    std::atomic<int> appliedPriority {0};
+    std::atomic<uint64> appliedAffinityMask {0};
+    std::atomic<bool> appliedFellBack {false};
+    std::atomic<int> appliedErrorCode {0};
+    std::atomic<int64> hopReadyTicks {0};
+    PerformanceCounters::Timing wakeupLatency;
+};
@@ -13,28 +13,116 @@
 #include "JuceHeader.h"
 #include "Visualizer.h"
 #include "Utilities.h"
+#include "BinMapping.h"
+#include "SpectrumRasteriser.h"
+#include "PerformanceCounters.h"
 
 class VisualizerComponent : public Component
 {
 public:
-    explicit VisualizerComponent (Visualizer& visualizer) : Component ("FFTDisplay"), visualizer (visualizer)
+    /** Each view draws with two of the Visualizer's displays, starting at firstDisplay, so
+        give every view of the same Visualizer a different one.
+    */
+    explicit VisualizerComponent (Visualizer& visualizer, int firstDisplayToUse = 0) :
+        Component ("FFTDisplay"),
+        visualizer (visualizer),
+        firstDisplay (firstDisplayToUse)
     {
-        fftInputBuffer.setSize (1, visualizer.getNumBins (), false, true);
-        maxInputBuffer.setSize (1, visualizer.getNumBins (), false, true);
+        jassert (firstDisplay + numDisplays <= Visualizer::maxNumDisplays);
 
-        redrawTimer.setCallback ([this] () { update (); });
-        redrawTimer.startTimerHz (60);
+        visualizer.acquireSource (source);
+
+        // Sized for the largest fft so that a change of fft order never reallocates here
+        fftInputBuffer.setSize (1, Visualizer::getMaxNumBins (), false, true);
+        maxInputBuffer.setSize (1, Visualizer::getMaxNumBins (), false, true);
+        dbBuffer.setSize (1, Visualizer::getMaxNumBins (), false, true);
+
+        redrawTimer.setCallback ([this] () { redraw (); });
+        redrawTimer.startTimerHz (refreshRate);
 
         maxResetTimer.setCallback ([this] () { resetMax (); });
 
         addAndMakeVisible (fftGraph);
         addAndMakeVisible (maxGraph);
+        addAndMakeVisible (waterfallGraph);
+        addChildComponent (performanceOverlay);
+
+        fftGraph.paintTiming = &fftPaintTiming;
+        maxGraph.paintTiming = &maxPaintTiming;
+        waterfallGraph.paintTiming = &waterfallPaintTiming;
+        performanceOverlay.getText = [this] () { return getPerformanceSnapshot ().toString (); };
+    }
+
+    ~VisualizerComponent ()
+    {
+        for (auto display = 0; display < numDisplays; ++display)
+            visualizer.setDisplayLayout (firstDisplay + display, {});
+
+        visualizer.releaseSource (source);
     }
 
     void resized () override
     {
-        maxGraph.setBounds (getLocalBounds ());
-        fftGraph.setBounds (getLocalBounds ());
+        auto bounds = getLocalBounds ();
+        waterfallGraph.setBounds (bounds.removeFromBottom (waterfallGraph.isVisible () ? roundToInt (bounds.getHeight () * waterfallProportion) : 0));
+
+        maxGraph.setBounds (bounds);
+        fftGraph.setBounds (bounds);
+        performanceOverlay.setBounds (getLocalBounds ().removeFromTop (210).removeFromLeft (420).reduced (8));
+
+        updateDisplayLayouts ();
+        maxOutOfDate = true;
+        needsRedraw = true;
+    }
+
+    /** Sets how many times a second the view checks for new frames. It only copies and
+        repaints when the Visualizer has published something since the last check, so
+        this is an upper limit on the frame rate rather than the rate the view works at.
+    */
+    void setRefreshRate (int framesPerSecond)
+    {
+        refreshRate = jmax (1, framesPerSecond);
+
+        if (showing)
+        {
+            redrawTimer.startTimerHz (refreshRate);
+            frameClock.restart ();
+        }
+    }
+
+    int getRefreshRate () const
+    {
+        return refreshRate;
+    }
+
+    /** When on, the fft thread converts the spectra to dB and maps them onto the graphs'
+        pixels, so the message thread only copies and paints them. Until the fft thread has
+        caught up with a resize, the graphs are converted here as they are when it's off.
+    */
+    void setRenderOnAnalysisThread (bool shouldRenderOnAnalysisThread)
+    {
+        renderOnAnalysisThread = shouldRenderOnAnalysisThread;
+        updateDisplayLayouts ();
+        maxOutOfDate = true;
+        needsRedraw = true;
+    }
+
+    void setFrequencyScale (BinMapping::Scale newScale)
+    {
+        frequencyScale = newScale;
+        updateDisplayLayouts ();
+        maxOutOfDate = true;
+        needsRedraw = true;
+    }
+
+    /** Shows the spectrum history as a waterfall across the bottom of the display, taking
+        up the given proportion of its height.
+    */
+    void setWaterfallVisible (bool shouldBeVisible, float proportionOfHeight = 0.5f)
+    {
+        waterfallProportion = jlimit (0.f, 1.f, proportionOfHeight);
+        waterfallGraph.setVisible (shouldBeVisible);
+        resized ();
     }
 
     void resetMax ()
@@ -43,11 +131,132 @@ public:
         maxResetTimer.stopTimer ();
     }
 
-private:
-    Visualizer& visualizer;
-    AudioBuffer<float> fftInputBuffer;
-    AudioBuffer<float> maxInputBuffer;
+    /** Chooses which of the Visualizer's spectra to display, see Visualizer::Source. The
+        old source is only released, so it keeps being analysed while anything else uses it.
+    */
+    void setSource (int newSource)
+    {
+        if (newSource == source)
+            return;
+
+        visualizer.acquireSource (newSource);
+        visualizer.releaseSource (source);
+        source = newSource;
+        maxOutOfDate = true;
+        needsRedraw = true;
+    }
+
+    int getSource () const
+    {
+        return source;
+    }
+
+    //==============================================================================
+    /** What the view and the Visualizer behind it have been doing, see getPerformanceSnapshot (). */
+    struct PerformanceSnapshot
+    {
+        Visualizer::PerformanceSnapshot visualizer;
+        PerformanceCounters::TimingSnapshot fftUpdate;
+        PerformanceCounters::TimingSnapshot fftPaint;
+        PerformanceCounters::TimingSnapshot maxUpdate;
+        PerformanceCounters::TimingSnapshot maxPaint;
+        PerformanceCounters::TimingSnapshot waterfallUpdate;
+        PerformanceCounters::TimingSnapshot waterfallPaint;
+        PerformanceCounters::TimingSnapshot audioToPixel;   // from the samples arriving to the graphs being painted with them
+        int64 numFramesDrawn {0};
+        int64 numFramesDropped {0};     // redraws missed because the timer callback came late
+
+        /** One line per stat, as the overlay shows them. */
+        String toString () const
+        {
+            if (! PerformanceCounters::enabled)
+                return "Performance counters are compiled out";
+
+            const auto& input = visualizer.input;
+            const auto fill = [&input] (int numSamples) { return String (100. * numSamples / jmax (1, input.bufferSize), 0) + "%"; };
+
+            StringArray lines;
+            lines.add ("analysis      " + visualizer.analysis.toString ());
+            lines.add ("publishing    " + visualizer.publishing.toString ());
+            lines.add ("input         " + fill (input.numSamplesBuffered) + " full, peak " + fill (visualizer.peakNumSamplesBuffered)
+                        + ", " + String (input.numOverruns) + " overruns");
+            lines.add ("fft thread    " + visualizer.thread.toString ());
+            lines.add ("fft wakeup    " + visualizer.thread.wakeupLatency.toString ());
+            lines.add ("publish lag   mean " + String (visualizer.publishLatency.averageMs, 3) + "  max " + String (visualizer.publishLatency.maxMs, 3) + " ms");
+            lines.add ("audio->pixel  " + audioToPixel.toString ());
+            lines.add ("fft update    " + fftUpdate.toString ());
+            lines.add ("fft paint     " + fftPaint.toString ());
+            lines.add ("max update    " + maxUpdate.toString ());
+            lines.add ("max paint     " + maxPaint.toString ());
+            lines.add ("waterfall     " + waterfallUpdate.toString ());
+            lines.add ("  paint       " + waterfallPaint.toString ());
+            lines.add ("ui frames     " + String (numFramesDrawn) + " drawn, " + String (numFramesDropped) + " dropped");
+            lines.add ("recording     " + String (visualizer.numRecordingFramesDropped) + " frames dropped");
+            return lines.joinIntoString ("\n");
+        }
+    };
+
+    /** Returns the view's update and paint times, its dropped frames and how long samples
+        take to reach the screen, along with the Visualizer's own counters. Call it from the
+        message thread, e.g. on a timer to log it.
+    */
+    PerformanceSnapshot getPerformanceSnapshot () const
+    {
+        PerformanceSnapshot snapshot;
+        snapshot.visualizer = visualizer.getPerformanceSnapshot ();
+        snapshot.fftUpdate = fftUpdateTiming.getSnapshot ();
+        snapshot.fftPaint = fftPaintTiming.getSnapshot ();
+        snapshot.maxUpdate = maxUpdateTiming.getSnapshot ();
+        snapshot.maxPaint = maxPaintTiming.getSnapshot ();
+        snapshot.waterfallUpdate = waterfallUpdateTiming.getSnapshot ();
+        snapshot.waterfallPaint = waterfallPaintTiming.getSnapshot ();
+        snapshot.audioToPixel = audioToPixelTiming.getSnapshot ();
+        snapshot.numFramesDrawn = numFramesDrawn.get ();
+        snapshot.numFramesDropped = frameClock.numDropped.get ();
+        return snapshot;
+    }
+
+    /** Clears the view's counters and the Visualizer's. */
+    void resetPerformanceCounters ()
+    {
+        for (auto* timing : { &fftUpdateTiming, &fftPaintTiming, &maxUpdateTiming, &maxPaintTiming,
+                              &waterfallUpdateTiming, &waterfallPaintTiming, &audioToPixelTiming })
+            timing->reset ();
+
+        numFramesDrawn.reset ();
+        frameClock.reset ();
+        visualizer.resetPerformanceCounters ();
+    }
+
+    /** Shows the performance snapshot over the top left of the graphs, updated a few times a second. */
+    void setPerformanceOverlayVisible (bool shouldBeVisible)
+    {
+        performanceOverlay.setVisible (shouldBeVisible);
+    }
+
+    bool isPerformanceOverlayVisible () const
+    {
+        return performanceOverlay.isVisible ();
+    }
+
+   #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+    void paintOverChildren (Graphics&) override
+    {
+        // Runs after the graphs have painted, so this is as close to the screen as the view gets
+        if (pendingArrivalTicks != 0)
+        {
+            audioToPixelTiming.record (PerformanceCounters::getTicks () - pendingArrivalTicks);
+            pendingArrivalTicks = 0;
+        }
+    }
+   #endif
+
+    //==============================================================================
+    // The graphs only need their renderBuffer filling, so they can also be drawn on their own.
 
+    /** Draws the max as a single stroked line. The trace is rebuilt from renderBuffer only
+        when update () finds it has changed, and only the columns that changed are repainted.
+    */
     class MaxGraph : public Component
     {
     public:
@@ -56,53 +265,138 @@ private:
             setBufferedToImage (true);
         }
 
-        void paint (Graphics& g) override
+        /** Call after writing a new max into renderBuffer. */
+        void update ()
         {
-            const auto numSegments = 50;
-            const auto numPixelsPerSegment = static_cast<int> (std::ceil (static_cast<float> (getWidth ()) / numSegments));
+            const auto width = renderBuffer.getNumSamples ();
+            const auto* values = renderBuffer.getReadPointer (0);
+            auto* drawnValues = drawnBuffer.getWritePointer (0);
 
-            for (auto i = 0; i < numSegments; ++i)
-            {
-                const auto start = i * numPixelsPerSegment;
-                const auto end = jmin (start + numPixelsPerSegment + 1, getWidth ());
+            auto firstChanged = traceIsValid ? width : 0;
+            auto lastChanged = traceIsValid ? -1 : width - 1;
 
-                drawLineSegment (g, start, end);
+            for (auto x = 0; x < width; ++x)
+            {
+                if (values[x] != drawnValues[x])
+                {
+                    firstChanged = jmin (firstChanged, x);
+                    lastChanged = x;
+                }
             }
+
+            if (lastChanged < firstChanged)
+                return;
+
+            FloatVectorOperations::copy (drawnValues, values, width);
+            buildTrace ();
+            traceIsValid = true;
+
+            // A changed pixel moves the trace as far as the next point either side of it
+            repaint (Rectangle<int>::leftTopRightBottom (firstChanged - decimation - 1, 0, lastChanged + decimation + 2, getHeight ()));
         }
 
-        void drawLineSegment (Graphics& g, int start, int end) const
+        void paint (Graphics& g) override
         {
-            Path path;
+            const PerformanceCounters::ScopedTiming timing (paintTiming);
 
-            const auto buffer = renderBuffer.getReadPointer (0);
+            if (points.empty ())
+                return;
 
-            const auto height = getHeight ();
+            // Only stroke the part of the trace inside the area being repainted
+            const auto clip = g.getClipBounds ();
+            const auto compareX = [] (const Point<float>& point, float x) { return point.x < x; };
 
-            auto prevX = static_cast<float> (start);
-            auto prevY = height - buffer[start] * height;
+            auto first = std::lower_bound (points.begin (), points.end (), static_cast<float> (clip.getX ()), compareX);
+            auto last = std::lower_bound (first, points.end (), static_cast<float> (clip.getRight ()), compareX);
 
-            path.startNewSubPath ({prevX, prevY});
+            if (first != points.begin ())
+                --first;
 
-            for (auto i = start + 1; i < end; ++i)
-            {
-                const auto x = static_cast<float> (i);
-                const auto y = height - buffer [i] * height;
+            if (last != points.end ())
+                ++last;
 
-                path.addLineSegment ({{prevX, prevY}, {x, y}}, 1.f);
-                prevX = x;
-                prevY = y;
-            }
+            path.clear ();
+            path.startNewSubPath (*first);
+
+            for (auto point = first + 1; point < last; ++point)
+                path.lineTo (*point);
 
             g.setColour (Colours::whitesmoke);
-            g.fillPath (path);
+            g.strokePath (path, PathStrokeType (1.f));
         }
 
         void resized () override
         {
-            renderBuffer.setSize (1, getWidth ());
+            const auto width = getWidth ();
+            renderBuffer.setSize (1, width);
+            drawnBuffer.setSize (1, width);
+
+            // At most two points per bucket, plus the two ends
+            const auto maxNumPoints = 2 * (width / decimation + 1) + 2;
+            points.clear ();
+            points.reserve (static_cast<size_t> (maxNumPoints));
+            path.clear ();
+            path.preallocateSpace (3 * maxNumPoints);
+
+            traceIsValid = false;
         }
 
         AudioBuffer<float> renderBuffer;
+        PerformanceCounters::Timing* paintTiming {nullptr};
+
+    private:
+        /** Reduces each bucket of pixels to its lowest and highest value, in the order they
+            occur, so the trace keeps every peak and dip with a fraction of the points.
+        */
+        void buildTrace ()
+        {
+            const auto width = drawnBuffer.getNumSamples ();
+            const auto height = static_cast<float> (getHeight ());
+            const auto* values = drawnBuffer.getReadPointer (0);
+
+            points.clear ();
+
+            const auto addPoint = [this, values, height] (int x)
+            {
+                const auto pointX = static_cast<float> (x);
+
+                if (points.empty () || points.back ().x != pointX)
+                    points.emplace_back (pointX, height - values[x] * height);
+            };
+
+            if (width == 0)
+                return;
+
+            addPoint (0);
+
+            for (auto start = 0; start < width; start += decimation)
+            {
+                const auto end = jmin (start + decimation, width);
+                auto lowest = start;
+                auto highest = start;
+
+                for (auto x = start + 1; x < end; ++x)
+                {
+                    if (values[x] < values[lowest])
+                        lowest = x;
+
+                    if (values[x] > values[highest])
+                        highest = x;
+                }
+
+                addPoint (jmin (lowest, highest));
+                addPoint (jmax (lowest, highest));
+            }
+
+            addPoint (width - 1);
+        }
+
+        static constexpr int decimation = 4;    // pixels per bucket
+
+        AudioBuffer<float> drawnBuffer;         // the values the trace was last built from
+        std::vector<Point<float>> points;
+        Path path;
+        bool traceIsValid {false};
     };
 
     class FftGraph : public Component
@@ -116,90 +410,405 @@ private:
 
         void paint (Graphics& g) override
         {
-            g.setColour (Colours::black);
-            g.fillRect (getLocalBounds ());
-            g.setColour (Colours::whitesmoke.withAlpha (0.2f));
-            const auto height = static_cast<float> (getHeight ());
-
-            const auto buffer = renderBuffer.getReadPointer (0);
+            const PerformanceCounters::ScopedTiming timing (paintTiming);
 
-            for (auto i = 0; i < getWidth (); ++i)
             {
-                const auto top = static_cast<float> (getHeight ()) - buffer[i] * height;
-                g.drawVerticalLine (i, top, height);
+                Image::BitmapData pixels (frame, Image::BitmapData::writeOnly);
+                rasteriser.render (renderBuffer.getReadPointer (0), renderBuffer.getNumSamples (), pixels);
             }
+
+            g.drawImageAt (frame, 0, 0);
         }
 
         void resized () override
         {
             renderBuffer.setSize (1, getWidth ());
+            frame = Image (Image::RGB, jmax (1, getWidth ()), jmax (1, getHeight ()), true, SoftwareImageType ());
         }
 
         AudioBuffer<float> renderBuffer;
+        PerformanceCounters::Timing* paintTiming {nullptr};
+
+    private:
+        SpectrumRasteriser rasteriser {Colours::black, Colours::whitesmoke.withAlpha (0.2f)};
+        Image frame;
+    };
+
+    /** A scrolling spectrogram, newest frame on the right and low frequencies at the bottom.
+
+        The history lives in an image used as a ring of columns: each new frame is drawn
+        into the oldest column and the write position moves on, so the cost of a frame is
+        one column of pixels however much history is kept. paint () blits the two halves of
+        the ring either side of the write position rather than redrawing anything.
+    */
+    class WaterfallGraph : public Component
+    {
+    public:
+        WaterfallGraph ()
+        {
+            setOpaque (true);
+
+            ColourGradient gradient;
+            gradient.addColour (0., Colours::black);
+            gradient.addColour (0.3, Colours::darkblue);
+            gradient.addColour (0.55, Colours::purple);
+            gradient.addColour (0.75, Colours::orangered);
+            gradient.addColour (0.9, Colours::yellow);
+            gradient.addColour (1., Colours::white);
+
+            for (auto i = 0; i < colourMapSize; ++i)
+                colourMap[static_cast<size_t> (i)] = gradient.getColourAtPosition (i / static_cast<double> (colourMapSize - 1)).getPixelARGB ();
+        }
+
+        void paint (Graphics& g) override
+        {
+            const PerformanceCounters::ScopedTiming timing (paintTiming);
+
+            if (! history.isValid ())
+                return;
+
+            const auto width = history.getWidth ();
+            const auto height = history.getHeight ();
+            const auto numOldColumns = width - writeColumn;
+
+            g.drawImage (history, 0, 0, numOldColumns, height, writeColumn, 0, numOldColumns, height);
+            g.drawImage (history, numOldColumns, 0, writeColumn, height, 0, 0, writeColumn, height);
+        }
+
+        void resized () override
+        {
+            columnBuffer.setSize (1, jmax (1, getHeight ()));
+
+            if (getWidth () <= 0 || getHeight () <= 0)
+            {
+                history = {};
+                return;
+            }
+
+            // Keep the history through a resize by unwrapping the ring into the new image
+            Image resizedHistory (Image::ARGB, getWidth (), getHeight (), true);
+
+            if (history.isValid ())
+            {
+                Graphics g (resizedHistory);
+                const auto width = history.getWidth ();
+                const auto scale = static_cast<float> (getWidth ()) / static_cast<float> (width);
+                const auto numOldColumns = width - writeColumn;
+
+                g.drawImage (history, 0, 0, roundToInt (numOldColumns * scale), getHeight (),
+                             writeColumn, 0, numOldColumns, history.getHeight ());
+                g.drawImage (history, roundToInt (numOldColumns * scale), 0, getWidth () - roundToInt (numOldColumns * scale), getHeight (),
+                             0, 0, writeColumn, history.getHeight ());
+            }
+            else
+            {
+                resizedHistory.clear (resizedHistory.getBounds (), Colours::black);
+            }
+
+            history = resizedHistory;
+            writeColumn = 0;
+        }
+
+        /** Draws columnBuffer, which holds a relative dB value per pixel from the top of the
+            graph down, as the newest column.
+        */
+        void addColumn ()
+        {
+            if (! history.isValid ())
+                return;
+
+            const auto height = history.getHeight ();
+            const auto values = columnBuffer.getReadPointer (0);
+
+            {
+                Image::BitmapData pixels (history, writeColumn, 0, 1, height, Image::BitmapData::writeOnly);
+
+                for (auto y = 0; y < height; ++y)
+                {
+                    const auto index = jlimit (0, colourMapSize - 1, static_cast<int> (values[y] * (colourMapSize - 1)));
+                    *reinterpret_cast<PixelARGB*> (pixels.getLinePointer (y)) = colourMap[static_cast<size_t> (index)];
+                }
+            }
+
+            writeColumn = (writeColumn + 1) % history.getWidth ();
+        }
+
+        AudioBuffer<float> columnBuffer;
+        int64 lastSamplePosition {-1};
+        PerformanceCounters::Timing* paintTiming {nullptr};
+
+    private:
+        static constexpr int colourMapSize = 256;
+
+        std::array<PixelARGB, colourMapSize> colourMap;
+        Image history;
+        int writeColumn {0};
+    };
+
+private:
+    /** The performance snapshot as text, over a translucent background. It lets clicks
+        through to the graphs underneath, and only refreshes while it's visible.
+    */
+    class PerformanceOverlay : public Component
+    {
+    public:
+        PerformanceOverlay ()
+        {
+            setInterceptsMouseClicks (false, false);
+            refreshTimer.setCallback ([this] ()
+            {
+                if (getText)
+                    text = getText ();
+
+                repaint ();
+            });
+        }
+
+        void paint (Graphics& g) override
+        {
+            g.setColour (Colours::black.withAlpha (0.7f));
+            g.fillRoundedRectangle (getLocalBounds ().toFloat (), 4.f);
+
+            g.setColour (Colours::lightgreen);
+            g.setFont (Font (Font::getDefaultMonospacedFontName (), 12.f, Font::plain));
+            g.drawFittedText (text, getLocalBounds ().reduced (8, 6), Justification::topLeft, 20, 1.f);
+        }
+
+        void visibilityChanged () override
+        {
+            if (isVisible ())
+            {
+                refreshTimer.timerCallback ();
+                refreshTimer.startTimerHz (4);
+            }
+            else
+            {
+                refreshTimer.stopTimer ();
+            }
+        }
+
+        std::function<String ()> getText;
+
+    private:
+        String text;
+        LambdaTimer refreshTimer;
+    };
+
+    enum
+    {
+        graphDisplay = 0,
+        waterfallDisplay,
+        numDisplays
     };
 
+    Visualizer& visualizer;
+    const int firstDisplay;
+    int source {Visualizer::sumSource};
+    bool maxOutOfDate {false};
+    bool needsRedraw {true};
+    bool showing {true};
+    uint32 lastFrameSequence {0};
+    int refreshRate {60};
+    bool renderOnAnalysisThread {true};
+    BinMapping::Scale frequencyScale {BinMapping::Scale::logarithmic};
+
+    Visualizer::FrameInfo rawFft;
+    bool rawFftCopied {false};
+
+    AudioBuffer<float> fftInputBuffer;
+    AudioBuffer<float> maxInputBuffer;
+    AudioBuffer<float> dbBuffer;
+
+    BinMapping graphMapping;        // shared by the fft and max graphs, which are the same width
+    BinMapping waterfallMapping;
+
     FftGraph fftGraph;
     MaxGraph maxGraph;
+    WaterfallGraph waterfallGraph;
+    float waterfallProportion {0.5f};
+    PerformanceOverlay performanceOverlay;
+
+    PerformanceCounters::Timing fftUpdateTiming;
+    PerformanceCounters::Timing fftPaintTiming;
+    PerformanceCounters::Timing maxUpdateTiming;
+    PerformanceCounters::Timing maxPaintTiming;
+    PerformanceCounters::Timing waterfallUpdateTiming;
+    PerformanceCounters::Timing waterfallPaintTiming;
+    PerformanceCounters::Timing audioToPixelTiming;
+    PerformanceCounters::Counter numFramesDrawn;
+    PerformanceCounters::FrameClock frameClock;
+    int64 pendingArrivalTicks {0};     // when the samples in the frame waiting to be painted arrived
 
     LambdaTimer redrawTimer;
     LambdaTimer maxResetTimer;
 
+    void redraw ()
+    {
+        // While the view isn't showing, check just often enough to notice it coming back
+        const auto hiddenRefreshRate = 4;
+
+        // isShowing () is false while the window is minimised as well as when the view is hidden
+        const auto nowShowing = isShowing ();
+
+        if (nowShowing != showing)
+        {
+            showing = nowShowing;
+            redrawTimer.startTimerHz (showing ? refreshRate : hiddenRefreshRate);
+
+            // Stops the fft thread rendering for a view no one can see
+            updateDisplayLayouts ();
+            frameClock.restart ();
+            maxOutOfDate = true;
+            needsRedraw = true;
+        }
+
+        if (! showing)
+            return;
+
+        frameClock.tick (refreshRate);
+        const auto frameSequence = visualizer.getFrameSequence ();
+
+        if (frameSequence != lastFrameSequence || needsRedraw)
+        {
+            lastFrameSequence = frameSequence;
+            needsRedraw = false;
+            update ();
+            numFramesDrawn.add ();
+
+           #if FFTVISUALIZER_PERFORMANCE_COUNTERS
+            pendingArrivalTicks = visualizer.getPublishedArrivalTicks ();
+           #endif
+        }
+    }
+
     void update ()
     {
-        if (isVisible ())
+        rawFftCopied = false;
+
         {
-            visualizer.copyCurrentFft (fftInputBuffer.getWritePointer (0), visualizer.getNumBins ());
-            updateRenderBuffer (fftGraph.renderBuffer, fftInputBuffer, getWidth (), visualizer.getNumBins ());
+            const PerformanceCounters::ScopedTiming timing (&fftUpdateTiming);
+            renderFft (fftGraph.renderBuffer, graphDisplay, graphMapping, fftGraph.getWidth ());
             fftGraph.repaint ();
+        }
 
-            if (visualizer.getMaxHasChanged ())
-            {
-                visualizer.copyCurrentMax (maxInputBuffer.getWritePointer (0), visualizer.getNumBins ());
-                updateRenderBuffer (maxGraph.renderBuffer, maxInputBuffer, getWidth (), visualizer.getNumBins ());
-                maxGraph.repaint ();
-                maxResetTimer.startTimer (5000);
-            }
+        if (waterfallGraph.isVisible ())
+        {
+            const PerformanceCounters::ScopedTiming timing (&waterfallUpdateTiming);
+            updateWaterfall ();
         }
+
+        const auto maxChanged = usesDisplay (maxGraph.getWidth ()) ? visualizer.getDisplayMaxHasChanged (firstDisplay + graphDisplay, source)
+                                                                   : visualizer.getMaxHasChanged (source);
+
+        if (maxChanged || maxOutOfDate)
+        {
+            const PerformanceCounters::ScopedTiming timing (&maxUpdateTiming);
+            maxOutOfDate = false;
+            renderMax ();
+            maxGraph.update ();
+            maxResetTimer.startTimer (5000);
+        }
+    }
+
+    void updateDisplayLayouts ()
+    {
+        const auto graphWidth = showing && usesDisplay (fftGraph.getWidth ()) ? fftGraph.getWidth () : 0;
+        const auto waterfallHeight = showing && waterfallGraph.isVisible () && usesDisplay (waterfallGraph.getHeight ()) ? waterfallGraph.getHeight () : 0;
+
+        visualizer.setDisplayLayout (firstDisplay + graphDisplay, { graphWidth, frequencyScale });
+        visualizer.setDisplayLayout (firstDisplay + waterfallDisplay, { waterfallHeight, frequencyScale });
+    }
+
+    /** Whether a graph of this many pixels is rendered by the fft thread. Wider than the
+        Visualizer's displays go, e.g. on a high DPI screen, it's converted here instead.
+    */
+    bool usesDisplay (int numPixels) const
+    {
+        return renderOnAnalysisThread && numPixels > 0 && numPixels <= Visualizer::maxNumDisplayPixels;
+    }
+
+    bool matchesLayout (const Visualizer::DisplayInfo& info, int numPixels) const
+    {
+        return info.numPixels == numPixels && info.scale == frequencyScale;
     }
 
-    static void updateRenderBuffer (AudioBuffer<float>& dest, const AudioBuffer<float>& source, int width, int numBins)
+    /** Copies the latest spectrum once per update, for whichever graphs can't use a display frame. */
+    const Visualizer::FrameInfo& copyRawFft ()
     {
-        const auto fft = source.getReadPointer (0);
-        const auto destination = dest.getWritePointer (0);
+        if (! rawFftCopied)
+        {
+            rawFft = visualizer.copyCurrentFft (fftInputBuffer.getWritePointer (0), fftInputBuffer.getNumSamples (), source);
+            rawFftCopied = true;
+        }
 
-        auto previousValue = getRelativeDbValue (fft[0], numBins);
+        return rawFft;
+    }
 
-        for (auto i = 0; i < width; ++i)
+    /** Fills dest with numPixels of the latest spectrum, as the fft thread rendered it if it
+        can, and returns the sample position of the frame.
+    */
+    int64 renderFft (AudioBuffer<float>& dest, int display, BinMapping& mapping, int numPixels)
+    {
+        if (usesDisplay (numPixels))
         {
-            const auto normPos = static_cast<float> (i) / static_cast<float> (width);
+            const auto info = visualizer.copyDisplayFft (firstDisplay + display, dest.getWritePointer (0), numPixels, source);
 
-            const auto binPos = RangeUtils::normalizedToLogRange (normPos, 1.f, static_cast<float> (numBins));
-            const auto bin = static_cast<int> (std::floor (binPos));
-            const auto nextBin = bin + 1 < numBins ? bin + 1 : bin;
-            const auto posInBin = binPos - bin;
+            if (matchesLayout (info, numPixels))
+                return info.samplePosition;
+        }
 
-            const auto interpolatedValue = getInterpolatedDbValue (fft[bin], fft[nextBin], posInBin, numBins);
-            const auto smoothedValue = 0.5f * (previousValue + interpolatedValue);
+        const auto& frame = copyRawFft ();
+        updateRenderBuffer (dest, fftInputBuffer, mapping, numPixels, frame);
+        return frame.samplePosition;
+    }
 
-            previousValue = smoothedValue;
+    void renderMax ()
+    {
+        const auto width = maxGraph.getWidth ();
+
+        if (usesDisplay (width))
+        {
+            if (matchesLayout (visualizer.copyDisplayMax (firstDisplay + graphDisplay, maxGraph.renderBuffer.getWritePointer (0), width, source), width))
+                return;
 
-            destination [i] = smoothedValue;
+            // Until the fft thread catches up with the layout, its max won't be flagged as
+            // changed, so keep converting the max here on every update
+            maxOutOfDate = true;
         }
+
+        const auto maxFrame = visualizer.copyCurrentMax (maxInputBuffer.getWritePointer (0), maxInputBuffer.getNumSamples (), source);
+        updateRenderBuffer (maxGraph.renderBuffer, maxInputBuffer, graphMapping, width, maxFrame);
     }
 
-    static float getInterpolatedDbValue (float lowerBinValue, float upperBinValue, float posInBin, int numBins)
+    /** Adds the latest frame to the waterfall if it hasn't been added already. Only the
+        newest frame is available on each redraw, so if frames arrive faster than the redraw
+        rate the ones in between aren't shown.
+    */
+    void updateWaterfall ()
     {
-        const auto lower = getRelativeDbValue (lowerBinValue, numBins);
-        const auto upper = getRelativeDbValue (upperBinValue, numBins);
+        // The same frequency mapping as the graphs, turned on its side with low frequencies at the bottom
+        auto& column = waterfallGraph.columnBuffer;
+        const auto height = column.getNumSamples ();
+        const auto samplePosition = renderFft (column, waterfallDisplay, waterfallMapping, height);
+
+        if (samplePosition == waterfallGraph.lastSamplePosition)
+            return;
+
+        auto* values = column.getWritePointer (0);
+        std::reverse (values, values + height);
 
-        return lower - posInBin * (lower - upper);
+        waterfallGraph.addColumn ();
+        waterfallGraph.lastSamplePosition = samplePosition;
+        waterfallGraph.repaint ();
     }
 
-    static float getRelativeDbValue (float fftValue, int numBins)
+    /** Converts a spectrum to relative dB, once per bin, and maps it onto numPixels pixels. */
+    void updateRenderBuffer (AudioBuffer<float>& dest, const AudioBuffer<float>& source, BinMapping& mapping, int numPixels, const Visualizer::FrameInfo& frame)
     {
-        const auto scaledValue = fftValue / static_cast<float> (2 * numBins);
-        const auto dBValue = Decibels::gainToDecibels (scaledValue, -100.f);
+        mapping.update (numPixels, frame.numBins, frequencyScale, Visualizer::getBinSpacing (frame.transform));
 
-        return dBValue / 100.f + 1.f;
+        const auto dB = dbBuffer.getWritePointer (0);
+        BinMapping::toRelativeDecibels (source.getReadPointer (0), dB, frame.numBins);
+        mapping.render (dB, dest.getWritePointer (0));
     }
 };
@@ -0,0 +1,168 @@
+/*
+  ==============================================================================
+
+    WindowFunction.h
+    Created: 16 Oct 2026 10:52:31pm
+    Author:  Alistair Barker
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** The analysis window, and the corrections that make the magnitudes read the same
+    whichever window is used.
+
+    Every window attenuates the signal by its coherent gain (its mean value) and widens
+    each bin to its equivalent noise bandwidth (ENBW, in bins). Rather than correcting the
+    magnitudes after the fft, the correction is folded into the window table, so it costs
+    nothing per frame: with tone calibration a full scale sine centred on a bin reads 1
+    (0 dB), and with noise calibration white noise reads the same level per bin with every
+    window.
+*/
+struct WindowFunction
+{
+    using Method = dsp::WindowingFunction<float>::WindowingMethod;
+
+    enum class Calibration
+    {
+        tone,   // sinusoid peaks read their amplitude, corrected for coherent gain
+        noise   // broadband levels are per bin, corrected for coherent gain and ENBW
+    };
+
+    struct Settings
+    {
+        Method method {dsp::WindowingFunction<float>::hamming};
+        float kaiserBeta {6.f};     // only used by the kaiser window
+        Calibration calibration {Calibration::tone};
+
+        bool operator== (const Settings& other) const
+        {
+            return method == other.method
+                && (method != dsp::WindowingFunction<float>::kaiser || kaiserBeta == other.kaiserBeta)
+                && calibration == other.calibration;
+        }
+
+        bool operator!= (const Settings& other) const   { return ! operator== (other); }
+    };
+
+    struct Properties
+    {
+        float coherentGain {1.f};   // the mean of the window
+        float enbw {1.f};           // equivalent noise bandwidth, in bins
+        float scale {1.f};          // what the window was multiplied by to calibrate it
+    };
+
+    /** Fills size samples with the calibrated window and returns its properties. */
+    static Properties fill (float* samples, int size, const Settings& settings)
+    {
+        dsp::WindowingFunction<float>::fillWindowingTables (samples, static_cast<size_t> (size), settings.method, false, settings.kaiserBeta);
+
+        auto sum = 0.0;
+        auto sumOfSquares = 0.0;
+
+        for (auto i = 0; i < size; ++i)
+        {
+            sum += samples[i];
+            sumOfSquares += static_cast<double> (samples[i]) * samples[i];
+        }
+
+        Properties properties;
+        properties.coherentGain = static_cast<float> (sum / size);
+        properties.enbw = static_cast<float> (size * sumOfSquares / (sum * sum));
+
+        // Only half the energy of a real sine lands in the positive frequency bins
+        const auto toneScale = 2.0 / sum;
+        const auto scale = settings.calibration == Calibration::tone ? toneScale : toneScale / std::sqrt (static_cast<double> (properties.enbw));
+        properties.scale = static_cast<float> (scale);
+
+        FloatVectorOperations::multiply (samples, properties.scale, size);
+        return properties;
+    }
+
+    static String getName (Method method)
+    {
+        switch (method)
+        {
+            case dsp::WindowingFunction<float>::rectangular:    return "rectangular";
+            case dsp::WindowingFunction<float>::triangular:     return "triangular";
+            case dsp::WindowingFunction<float>::hann:           return "hann";
+            case dsp::WindowingFunction<float>::hamming:        return "hamming";
+            case dsp::WindowingFunction<float>::blackman:       return "blackman";
+            case dsp::WindowingFunction<float>::blackmanHarris: return "blackman-harris";
+            case dsp::WindowingFunction<float>::flatTop:        return "flat-top";
+            case dsp::WindowingFunction<float>::kaiser:         return "kaiser";
+            default:                                            return {};
+        }
+    }
+
+    /** Returns true and sets method if name is one getName () returns. */
+    static bool getMethodFromName (const String& name, Method& method)
+    {
+        for (auto i = 0; i < dsp::WindowingFunction<float>::numWindowingMethods; ++i)
+        {
+            if (getName (static_cast<Method> (i)) == name)
+            {
+                method = static_cast<Method> (i);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /** Windows for every fft size from minOrder to maxOrder, built together so that the
+        analysis thread can change window or fft size without allocating or computing one.
+    */
+    class Tables
+    {
+    public:
+        /** Builds the tables, unless they were already built with the same settings. */
+        void build (const Settings& newSettings, int minOrder, int maxOrder)
+        {
+            const auto numOrders = maxOrder - minOrder + 1;
+
+            if (isBuilt && newSettings == settings && static_cast<int> (tables.size ()) == numOrders)
+                return;
+
+            settings = newSettings;
+            firstOrder = minOrder;
+            tables.resize (static_cast<size_t> (numOrders));
+            properties.resize (static_cast<size_t> (numOrders));
+
+            for (auto i = 0; i < numOrders; ++i)
+            {
+                const auto size = 1 << (minOrder + i);
+                auto& table = tables[static_cast<size_t> (i)];
+                table.resize (static_cast<size_t> (size));
+                properties[static_cast<size_t> (i)] = fill (table.data (), size, settings);
+            }
+
+            isBuilt = true;
+        }
+
+        const float* getTable (int order) const noexcept
+        {
+            return tables[static_cast<size_t> (order - firstOrder)].data ();
+        }
+
+        const Properties& getProperties (int order) const noexcept
+        {
+            return properties[static_cast<size_t> (order - firstOrder)];
+        }
+
+        const Settings& getSettings () const noexcept
+        {
+            return settings;
+        }
+
+    private:
+        Settings settings;
+        int firstOrder {0};
+        bool isBuilt {false};
+        std::vector<std::vector<float>> tables;
+        std::vector<Properties> properties;
+    };
+};